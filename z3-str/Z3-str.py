@@ -6,6 +6,11 @@ import getopt
 import time
 import os
 import subprocess
+import hashlib
+import cPickle
+import collections
+import multiprocessing
+import threading
 
 # "solver" should point to the binary built. 
 # e.g. "/home/z3-str/str" or "/home/work/tool/z3/myStrTheory/str"
@@ -17,6 +22,33 @@ solver = "/home/lumtics/Z3-str-Regex/z3-str/str"
 tmpEncodingDir = "/tmp/z3_str_convert"
 clearTempFile = 1
 checkAnswer = 0
+# SAT and UNSAT results are cached on disk, one file per query in
+# "queryCacheDir", named by a hash of the query (variables renamed,
+# assertions sorted) and of the options that can change the answer. The
+# least recently used entries are dropped once the cache holds more than
+# "queryCacheSize" queries.
+useQueryCache = 1
+queryCacheDir = "/tmp/z3_str_convert/query_results"
+queryCacheSize = 10000
+# Assertions that share no variable are solved by separate solver runs,
+# "sliceJobs" of them at a time (0 means one per CPU).
+useSlicing = 1
+sliceJobs = 0
+# UNSAT core cache, off unless "-c" is given: the solver then runs under
+# assumption literals and on UNSAT reports the top-level assertions in an
+# UNSAT core. Cores (checked, and minimised when they have at most
+# "unsatCoreMinimiseMax" assertions) are kept in "unsatCoreFile". A query
+# that contains every assertion of a known core is UNSAT without solving.
+# Checking and minimising one core takes at most "unsatCoreMinimiseTime"
+# seconds of solver runs; what is left unchecked stays in the core.
+useUnsatCoreCache = 0
+unsatCoreFile = "/tmp/z3_str_convert/unsat_cores"
+unsatCoreLimit = 10000
+unsatCoreMinimiseMax = 16
+unsatCoreMinimiseTime = 10
+# Solve Concat equalities with Nielsen transformations first ("--nielsen"),
+# the arrangement splits are only used when they cannot decide the next step.
+useNielsen = 0
 #=================================================================== 
 
 encodeDict = {
@@ -96,14 +128,7 @@ def encodeConstStr(constStr):
     print "Exit..."
     sys.exit(1) 
   
-  p = 0
-  result = ""
-  while p < len(constStr):
-    cc = encodeDict[ constStr[p] ]
-    result = result + cc
-    p += 1
-  result = "__cOnStStR_" + result
-  return result
+  return "__cOnStStR_" + "".join([encodeDict[c] for c in constStr])
 
 def encodeRegex(regex):
   try:
@@ -113,19 +138,13 @@ def encodeRegex(regex):
     print "Exit..."
     sys.exit(1) 
   
-  p = 0
-  result = ""
-  while p < len(regex):
-    cc = encodeDict[ regex[p] ]
-    result = result + cc
-    p += 1
-  result = "__regex_" + result
-  return result
+  return "__regex_" + "".join([encodeDict[c] for c in regex])
 
 
 varTypeDict = {}
 varSolution = {}
 fileContent = ""
+unsatCoreIdx = None
 
 
 def convert(org_file, convertedOriginalFile):  
@@ -135,14 +154,14 @@ def convert(org_file, convertedOriginalFile):
   declared_string_var = []
   declared_string_const = []
   declared_regex = []
-  converted_cstr = ""  
-  
-  f_o = open(org_file, 'r')    
-  fileContent = f_o.read()  
-  f_o.close()
+  declared_set = set()
+  # collect pieces in lists and join once, the input may be large
+  rawLines = []
+  converted_cstr = []
   
-  linesInFile = fileContent.split("\n")  
-  for line in linesInFile:    
+  f_o = open(org_file, 'r')
+  for line in f_o:
+    rawLines.append(line)
     line = line.strip();
     line = line.replace('\t', ' ')
     if line == "":
@@ -212,7 +231,8 @@ def convert(org_file, convertedOriginalFile):
       encoded_s = encodeConstStr( old_s[1 : len(old_s) - 1] )      
       line = line.replace(old_s, encoded_s)
       
-      if encoded_s not in declared_string_const:
+      if encoded_s not in declared_set:
+        declared_set.add(encoded_s)
         declared_string_const.append(encoded_s)
       p1 = p2
     # -----------------------------
@@ -244,27 +264,27 @@ def convert(org_file, convertedOriginalFile):
       encoded_s = encodeRegex( old_s[1 : len(old_s) - 1] )      
       line = line.replace(old_s, encoded_s)
       
-      if encoded_s not in declared_string_const:
+      if encoded_s not in declared_set:
+        declared_set.add(encoded_s)
         declared_regex.append(encoded_s)
       p1 = p2
     # -----------------------------
     # end: processing const string
-    converted_cstr = converted_cstr + line + '\n'
-  
+    converted_cstr.append(line + '\n')
+  f_o.close()
+  fileContent = "".join(rawLines)
   
-  output_str = ""
+  # -------------------------------------
+  f_n = open(convertedOriginalFile, 'w')
   for strv in declared_string_var:
-    output_str = output_str + strv + "\n"  
-  output_str = output_str + '\n'  
+    f_n.write(strv + "\n")
+  f_n.write('\n')
   for str_const in declared_string_const:
-    output_str = output_str + '(declare-const ' + str_const + ' String)\n'    
+    f_n.write('(declare-const ' + str_const + ' String)\n')
   for regex in declared_regex:
-    output_str = output_str + '(declare-const ' + regex + ' Regex)\n'    
-  output_str = output_str + '\n'
-  output_str = output_str + converted_cstr
-  # -------------------------------------
-  f_n = open(convertedOriginalFile, 'w')
-  f_n.write(output_str)        
+    f_n.write('(declare-const ' + regex + ' Regex)\n')
+  f_n.write('\n')
+  f_n.writelines(converted_cstr)
   f_n.close()  
   
 
@@ -272,6 +292,7 @@ def convert(org_file, convertedOriginalFile):
 
 def processOutput(output):
   global varSolution
+  global unsatCoreIdx
   
   if output.find("(error ") != -1:
     return output, 1
@@ -288,6 +309,11 @@ def processOutput(output):
       continue
     elif line.startswith('unique-value!'):
       continue    
+    elif line.startswith('>> UNSAT CORE'):
+      # ">> UNSAT CORE (<#assertions>): i j k"
+      fields = line[line.find('(') + 1:].replace('):', ' ').split()
+      unsatCoreIdx = (int(fields[0]), [int(i) for i in fields[1:]])
+      continue
     elif line.startswith('**************') or line.startswith('>> ') or line.startswith('--------------'):
       result.append(line)
       result.append("\n")
@@ -331,9 +357,523 @@ def genSolAsserts():
   
 
 
+#===================================================================
+# Query cache
+#   Two queries that only differ in variable names and assertion order
+#   get the same key. The cached output uses the canonical variable names,
+#   which are mapped back to the names used in the current query on a hit.
+#===================================================================
+
+def sexprTokens(text):
+  tokens = []
+  p = 0
+  while p < len(text):
+    c = text[p]
+    if c.isspace():
+      p = p + 1
+    elif c == '(' or c == ')':
+      tokens.append(c)
+      p = p + 1
+    elif c == '"' or c == "'":
+      # string constant or regex, same escaping rule as convert()
+      p2 = p + 1
+      while p2 < len(text):
+        if text[p2] == '\\':
+          if p2 + 1 < len(text) and (text[p2 + 1] == c or text[p2 + 1] == '\\'):
+            p2 = p2 + 2
+            continue
+        elif text[p2] == c:
+          break
+        p2 = p2 + 1
+      if p2 >= len(text):
+        return None
+      tokens.append(text[p : p2 + 1])
+      p = p2 + 1
+    else:
+      p2 = p
+      while p2 < len(text) and not text[p2].isspace() and text[p2] not in '()\"\'':
+        p2 = p2 + 1
+      tokens.append(text[p : p2])
+      p = p2
+  return tokens
+
+
+def sexprParse(tokens):
+  stack = [[]]
+  for tok in tokens:
+    if tok == '(':
+      stack.append([])
+    elif tok == ')':
+      if len(stack) == 1:
+        return None
+      item = stack.pop()
+      stack[-1].append(item)
+    else:
+      stack[-1].append(tok)
+  if len(stack) != 1:
+    return None
+  return stack[0]
+
+
+def sexprToStr(expr, renameMap):
+  if isinstance(expr, list):
+    return '(' + ' '.join([sexprToStr(e, renameMap) for e in expr]) + ')'
+  return renameMap.get(expr, expr)
+
+
+def collectVarOrder(expr, declared, order):
+  if isinstance(expr, list):
+    for e in expr:
+      collectVarOrder(e, declared, order)
+  elif expr in declared and expr not in order:
+    order[expr] = len(order)
+
+
+#
+# Split a query into declarations and assertions.
+# Return None if it has commands that make the result depend on more
+# than the set of assertions (push/pop, ...).
+#
+def parseQuery(content):
+  lines = []
+  for line in content.split("\n"):
+    line = line.strip()
+    if line.startswith(';') or line.startswith('%') or line.startswith('//'):
+      continue
+    lines.append(line)
+  tokens = sexprTokens("\n".join(lines))
+  if tokens == None:
+    return None
+  cmds = sexprParse(tokens)
+  if cmds == None:
+    return None
+
+  declared = {}
+  declCmds = collections.OrderedDict()
+  assertCmds = []
+  for cmd in cmds:
+    if not isinstance(cmd, list) or len(cmd) == 0:
+      return None
+    if cmd[0] in ('declare-variable', 'declare-const', 'declare-fun'):
+      if len(cmd) < 3 or isinstance(cmd[1], list):
+        return None
+      declared[cmd[1]] = sexprToStr(cmd[2:], {})
+      declCmds[cmd[1]] = cmd
+    elif cmd[0] == 'assert':
+      assertCmds.append(cmd)
+    elif cmd[0] in ('check-sat', 'get-model', 'set-option', 'set-info', 'set-logic', 'exit'):
+      continue
+    else:
+      return None
+  return declared, declCmds, assertCmds
+
+
+#
+# Return (key, renameMap), or (None, None) if the query cannot be cached.
+# "options" are the settings the answer depends on, they go into the key.
+#
+def canonicalQuery(content, options):
+  parsed = parseQuery(content)
+  if parsed == None:
+    return None, None
+  declared, declCmds, assertCmds = parsed
+  declOrder = declCmds.keys()
+  asserts = [cmd[1:] for cmd in assertCmds]
+
+  # order assertions by their shape, with all variables made anonymous
+  shapeMap = dict([(name, '?') for name in declared])
+  shaped = [(sexprToStr(a, shapeMap), a) for a in asserts]
+  shaped.sort(key = lambda x: x[0])
+
+  order = collections.OrderedDict()
+  for shape, a in shaped:
+    collectVarOrder(a, declared, order)
+  # variables declared but never used still show up in the model
+  unused = [name for name in declOrder if name not in order]
+  unused.sort(key = lambda name: declared[name])
+  for name in unused:
+    order[name] = len(order)
+
+  renameMap = {}
+  for name, idx in order.items():
+    renameMap[name] = "__cv" + str(idx)
+
+  canon = []
+  for name in order:
+    canon.append("(declare " + renameMap[name] + " " + declared[name] + ")")
+  seen = {}
+  for shape, a in shaped:
+    aStr = sexprToStr(a, renameMap)
+    if aStr not in seen:
+      seen[aStr] = 1
+      canon.append(aStr)
+  canon.append("(options " + " ".join(options) + ")")
+  return hashlib.sha1("\n".join(canon)).hexdigest(), renameMap
+
+
+def renameModelLines(output, renameMap):
+  result = []
+  for line in output.split("\n"):
+    if line.find(" -> ") != -1:
+      name = line.split(" -> ")[0].split(":")[0].strip()
+      if name in renameMap:
+        line = renameMap[name] + line[line.find(name) + len(name):]
+    result.append(line)
+  return "\n".join(result)
+
+
+#
+# Solver arguments that can change the answer
+#
+def solverOptions():
+  options = []
+  if useNielsen == 1:
+    options.append("--nielsen")
+  return options
+
+
+def queryCacheOptions():
+  return solverOptions() + ["check=" + str(checkAnswer)]
+
+
+def queryCachePath(key):
+  return os.path.join(queryCacheDir, key)
+
+
+#
+# A hit reads one file and only touches its time, which is what the
+# eviction in pruneQueryCache() goes by.
+#
+def queryCacheLookup(key, renameMap):
+  path = queryCachePath(key)
+  try:
+    f_c = open(path, 'r')
+    output = f_c.read()
+    f_c.close()
+  except IOError:
+    return None
+  try:
+    os.utime(path, None)
+  except OSError:
+    pass
+  backMap = dict([(v, k) for k, v in renameMap.items()])
+  return renameModelLines(output, backMap)
+
+
+def pruneQueryCache():
+  names = [name for name in os.listdir(queryCacheDir) if not name.startswith(".")]
+  if len(names) <= queryCacheSize:
+    return
+  entries = []
+  for name in names:
+    path = queryCachePath(name)
+    try:
+      entries.append((os.path.getmtime(path), path))
+    except OSError:
+      pass
+  entries.sort()
+  for mtime, path in entries[:len(entries) - queryCacheSize]:
+    try:
+      os.remove(path)
+    except OSError:
+      pass
+
+
+def queryCacheStore(key, renameMap, output):
+  try:
+    os.makedirs(queryCacheDir)
+  except OSError:
+    pass
+  # write then rename, so that a concurrent reader never sees half a file
+  tmpFile = os.path.join(queryCacheDir, "." + key + "." + str(os.getpid()))
+  f_c = open(tmpFile, 'w')
+  f_c.write(renameModelLines(output, renameMap))
+  f_c.close()
+  os.rename(tmpFile, queryCachePath(key))
+  pruneQueryCache()
+
+
+queryKey = None
+queryRenameMap = None
+
+def emitResult(output):
+  sys.stdout.write(output)
+  # UNKNOWN may not come back on another run, so it is never cached
+  if queryKey != None and (output.find(">> SAT") != -1 or output.find(">> UNSAT") != -1):
+    queryCacheStore(queryKey, queryRenameMap, output)
+
+
+
+#===================================================================
+# Independence slicing
+#   Assertions are grouped by shared variables. Each group is solved by
+#   its own run of this script (so the query cache applies per group),
+#   and the models of all groups are merged.
+#===================================================================
+
+def findRoot(parent, v):
+  while parent[v] != v:
+    parent[v] = parent[parent[v]]
+    v = parent[v]
+  return v
+
+
+def sliceQueryComponents(content):
+  parsed = parseQuery(content)
+  if parsed == None:
+    return None
+  declared, declCmds, assertCmds = parsed
+
+  parent = dict([(name, name) for name in declared])
+  assertVars = []
+  for cmd in assertCmds:
+    order = collections.OrderedDict()
+    collectVarOrder(cmd, declared, order)
+    names = order.keys()
+    for name in names[1:]:
+      r1 = findRoot(parent, names[0])
+      r2 = findRoot(parent, name)
+      if r1 != r2:
+        parent[r2] = r1
+    assertVars.append(names)
+
+  groups = collections.OrderedDict()
+  for i in range(len(assertCmds)):
+    if len(assertVars[i]) == 0:
+      root = ('ground', i)
+    else:
+      root = findRoot(parent, assertVars[i][0])
+    if root not in groups:
+      groups[root] = []
+    groups[root].append(assertCmds[i])
+  if len(groups) <= 1:
+    return None
+
+  usedNames = {}
+  for names in assertVars:
+    for name in names:
+      usedNames[name] = 1
+
+  groupRoots = groups.keys()
+  components = []
+  for root in groupRoots:
+    text = ""
+    for name in declCmds:
+      inGroup = findRoot(parent, name) == root
+      # declared but unused variables go with the first group
+      unused = name not in usedNames and root == groupRoots[0]
+      if inGroup or unused:
+        text = text + sexprToStr(declCmds[name], {}) + "\n"
+    for cmd in groups[root]:
+      text = text + sexprToStr(cmd, {}) + "\n"
+    text = text + "(check-sat)\n(get-model)\n"
+    components.append(text)
+  return components
+
+
+def solveComponents(components, fileName):
+  jobs = sliceJobs
+  if jobs <= 0:
+    jobs = multiprocessing.cpu_count()
+
+  compFiles = []
+  for i in range(len(components)):
+    compFile = os.path.join(tmpEncodingDir, "slice_" + str(os.getpid()) + "_" + str(i) + "_" + fileName)
+    f_s = open(compFile, 'w')
+    f_s.write(components[i])
+    f_s.close()
+    compFiles.append(compFile)
+
+  outputs = [None] * len(compFiles)
+  running = []
+  next = 0
+  while next < len(compFiles) or len(running) > 0:
+    while next < len(compFiles) and len(running) < jobs:
+      paras = [sys.executable, os.path.abspath(__file__), "-s", "-f", compFiles[next]]
+      if useQueryCache != 1:
+        paras.insert(2, "-n")
+      if useUnsatCoreCache == 1:
+        paras.insert(2, "-c")
+      if useNielsen == 1:
+        paras.insert(2, "-e")
+      running.append((next, subprocess.Popen(paras, stdout = subprocess.PIPE)))
+      next = next + 1
+    idx, proc = running.pop(0)
+    outputs[idx] = proc.communicate()[0]
+
+  if clearTempFile == 1:
+    for compFile in compFiles:
+      if os.path.exists(compFile):
+        os.remove(compFile)
+
+  # UNSAT in any group decides the query, then UNKNOWN (or an error)
+  for out in outputs:
+    if out.find(">> UNSAT") != -1:
+      return out
+  for out in outputs:
+    if out.find(">> SAT") == -1:
+      return out
+
+  result = []
+  if all([out.find("* v-ok") != -1 for out in outputs]):
+    result.append("* v-ok\n")
+  result.append("************************\n>> SAT\n------------------------\n")
+  for out in outputs:
+    for line in out.split("\n"):
+      if line.find(" -> ") != -1:
+        result.append(line + "\n")
+  result.append("************************\n")
+  return ''.join(result)
+
+
+
+#===================================================================
+# UNSAT core cache
+#   A core is a set of assertion hashes. "index" maps an assertion hash
+#   to the cores it belongs to, so a query only looks at the cores that
+#   share an assertion with it.
+#===================================================================
+
+def assertionHashes(content):
+  parsed = parseQuery(content)
+  if parsed == None:
+    return None
+  declared, declCmds, assertCmds = parsed
+  hashes = []
+  for cmd in assertCmds:
+    order = collections.OrderedDict()
+    collectVarOrder(cmd, declared, order)
+    sorts = sorted([name + ":" + declared[name] for name in order])
+    hashes.append(hashlib.sha1(sexprToStr(cmd, {}) + "|" + ",".join(sorts)).hexdigest())
+  return hashes
+
+
+def loadUnsatCores():
+  if os.path.exists(unsatCoreFile):
+    try:
+      f_c = open(unsatCoreFile, 'rb')
+      store = cPickle.load(f_c)
+      f_c.close()
+      return store
+    except Exception:
+      pass
+  return {'cores' : collections.OrderedDict(), 'index' : {}}
+
+
+def saveUnsatCores(store):
+  cores = store['cores']
+  index = store['index']
+  while len(cores) > unsatCoreLimit:
+    coreKey, core = cores.popitem(last = False)
+    for h in core:
+      index[h].discard(coreKey)
+      if len(index[h]) == 0:
+        del index[h]
+  tmpFile = unsatCoreFile + "." + str(os.getpid())
+  f_c = open(tmpFile, 'wb')
+  cPickle.dump(store, f_c, 2)
+  f_c.close()
+  os.rename(tmpFile, unsatCoreFile)
+
+
+def unsatCoreLookup(hashes):
+  store = loadUnsatCores()
+  cores = store['cores']
+  index = store['index']
+  hits = {}
+  for h in set(hashes):
+    for coreKey in index.get(h, ()):
+      hits[coreKey] = hits.get(coreKey, 0) + 1
+      if hits[coreKey] == len(cores[coreKey]):
+        return True
+  return False
+
+
+def unsatCoreStore(hashes):
+  core = tuple(sorted(set(hashes)))
+  coreKey = hashlib.sha1(",".join(core)).hexdigest()
+  store = loadUnsatCores()
+  if coreKey in store['cores']:
+    return
+  store['cores'][coreKey] = core
+  for h in core:
+    store['index'].setdefault(h, set()).add(coreKey)
+  saveUnsatCores(store)
+
+
+#
+# False when the subset is not UNSAT, or when the solver does not answer
+# before "deadline"
+#
+def isUnsatSubset(declCmds, assertCmds, subset, fileName, deadline):
+  global fileContent
+  if time.time() >= deadline:
+    return False
+  text = ""
+  for name in declCmds:
+    text = text + sexprToStr(declCmds[name], {}) + "\n"
+  for i in subset:
+    text = text + sexprToStr(assertCmds[i], {}) + "\n"
+  text = text + "(check-sat)\n"
+
+  coreFile = os.path.join(tmpEncodingDir, "core_" + str(os.getpid()) + "_" + fileName)
+  convertedCoreFile = os.path.join(tmpEncodingDir, "core_conv_" + str(os.getpid()) + "_" + fileName)
+  f_n = open(coreFile, 'w')
+  f_n.write(text)
+  f_n.close()
+  savedContent = fileContent
+  convert(coreFile, convertedCoreFile)
+  fileContent = savedContent
+  proc = subprocess.Popen([solver, "-f", convertedCoreFile] + solverOptions(), stdout = subprocess.PIPE)
+  timer = threading.Timer(max(deadline - time.time(), 0), proc.kill)
+  timer.start()
+  output = proc.communicate()[0]
+  timer.cancel()
+  if clearTempFile == 1:
+    for f in (coreFile, convertedCoreFile):
+      if os.path.exists(f):
+        os.remove(f)
+  return output.find(">> UNSAT") != -1
+
+
+#
+# Called after the solver answered UNSAT with "-c".
+#
+def recordUnsatCore(content, fileName):
+  parsed = parseQuery(content)
+  if parsed == None:
+    return
+  declared, declCmds, assertCmds = parsed
+  hashes = assertionHashes(content)
+  allIdx = range(len(assertCmds))
+  core = allIdx
+  deadline = time.time() + unsatCoreMinimiseTime
+  # the solver numbers the top-level conjuncts, which are the assertions
+  # unless there is a single one
+  if unsatCoreIdx != None and unsatCoreIdx[0] == len(assertCmds):
+    core = unsatCoreIdx[1]
+    if len(core) == 0 or (len(core) < len(allIdx) and not isUnsatSubset(declCmds, assertCmds, core, fileName, deadline)):
+      core = allIdx
+  if len(core) <= unsatCoreMinimiseMax:
+    i = 0
+    while i < len(core) and len(core) > 1 and time.time() < deadline:
+      trial = core[:i] + core[i + 1:]
+      if isUnsatSubset(declCmds, assertCmds, trial, fileName, deadline):
+        core = trial
+      else:
+        i = i + 1
+  unsatCoreStore([hashes[i] for i in core])
+
+
+
 def printUseage():
   print 'USAGE: '
   print '  Z3-str.py -f <inputfile>\n'  
+  print '  -n    do not use the query result cache'
+  print '  -s    do not split the query into independent parts'
+  print '  -c    use the UNSAT core cache'
+  print '  -u    do not use the UNSAT core cache (default)'
+  print '  -e    solve Concat equalities with the Nielsen engine'
   print '\n'
   
       
@@ -346,7 +886,7 @@ if __name__ == '__main__':
   freeVarMaxLen = 0
   
   try:
-    opts, args = getopt.getopt(argv,"hf:")
+    opts, args = getopt.getopt(argv,"hnscuef:")
   except getopt.GetoptError:
     printUseage()
     sys.exit()
@@ -356,6 +896,16 @@ if __name__ == '__main__':
       sys.exit()
     elif opt in ("-f"):
       inputFile = arg
+    elif opt == '-n':
+      useQueryCache = 0
+    elif opt == '-s':
+      useSlicing = 0
+    elif opt == '-c':
+      useUnsatCoreCache = 1
+    elif opt == '-u':
+      useUnsatCoreCache = 0
+    elif opt == '-e':
+      useNielsen = 1
     
       
   if inputFile == '':
@@ -370,7 +920,34 @@ if __name__ == '__main__':
   if not os.path.exists(convertDir):
     os.makedirs(convertDir)
   
+  if useQueryCache == 1:
+    f_q = open(inputFile, 'r')
+    queryKey, queryRenameMap = canonicalQuery(f_q.read(), queryCacheOptions())
+    f_q.close()
+    if queryKey != None:
+      cachedOutput = queryCacheLookup(queryKey, queryRenameMap)
+      if cachedOutput != None:
+        sys.stdout.write(cachedOutput)
+        sys.exit(0)
+
   fileName = os.path.basename(inputFile);    
+
+  if useUnsatCoreCache == 1:
+    f_q = open(inputFile, 'r')
+    hashes = assertionHashes(f_q.read())
+    f_q.close()
+    if hashes != None and unsatCoreLookup(hashes):
+      emitResult("************************\n>> UNSAT\n************************\n")
+      sys.exit(0)
+
+  if useSlicing == 1:
+    f_q = open(inputFile, 'r')
+    components = sliceQueryComponents(f_q.read())
+    f_q.close()
+    if components != None:
+      emitResult(solveComponents(components, fileName))
+      sys.exit(0)
+
   convertedOriginalFile = os.path.join(convertDir, fileName)   
   
   rr = convert(inputFile, convertedOriginalFile)
@@ -379,7 +956,9 @@ if __name__ == '__main__':
     
   try:
     start = time.time() 
-    paras = [solver, "-f", convertedOriginalFile]
+    paras = [solver, "-f", convertedOriginalFile] + solverOptions()
+    if useUnsatCoreCache == 1:
+      paras.append("-c")
      
     # --------------------------------------------------  
     # Solve the origial constraints.
@@ -393,10 +972,13 @@ if __name__ == '__main__':
       sys.stdout.write(outStr)
       print "> Exit"
       sys.exit(0)
+
+    if useUnsatCoreCache == 1 and outStr.find(">> UNSAT") != -1:
+      recordUnsatCore(fileContent, fileName)
     
     
     if checkAnswer != 1:
-      print outStr
+      emitResult(outStr + "\n")
       sys.exit(0)
     
     # Remove the temp file of the encoding of the original input
@@ -413,9 +995,7 @@ if __name__ == '__main__':
     # --------------------------------------------------
     if outStr.find("String!val!") != -1:
 
-        print "************************"
-        print ">> UNKNOWN  (1)"
-        print "************************" 
+        emitResult("************************\n>> UNKNOWN  (1)\n************************\n")
     elif outStr.find(">> SAT") != -1: 
       ii = fileContent.find("(check-sat)")    
       solutionAssert = genSolAsserts()
@@ -427,26 +1007,23 @@ if __name__ == '__main__':
       f_n.close()
       
       convert(verifyInputFilename, convertedVerifyInputFilename)
-      paras = [solver, "-f", convertedVerifyInputFilename]
+      paras = [solver, "-f", convertedVerifyInputFilename] + solverOptions()
       
       # run the solver again, check the solution.
       err1 = subprocess.check_output(paras, );
       if err1.find(">> SAT") != -1:
-        print "* v-ok" 
-        sys.stdout.write(outStr)  
+        emitResult("* v-ok\n" + outStr)
         eclapse = (time.time() - start)
       else:
 
-        print "************************"
-        print ">> UNKNOWN (2)"
-        print "************************"
+        emitResult("************************\n>> UNKNOWN (2)\n************************\n")
       if clearTempFile == 1:
         if os.path.exists(verifyInputFilename):
           os.remove(verifyInputFilename)
         if os.path.exists(convertedVerifyInputFilename):
           os.remove(convertedVerifyInputFilename)
     else:
-      sys.stdout.write(outStr)  
+      emitResult(outStr)
       eclapse = (time.time() - start)
   except KeyboardInterrupt:
     print "Interrupted by keyborad"
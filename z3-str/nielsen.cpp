@@ -0,0 +1,188 @@
+#include "strTheory.h"
+
+/*
+ * OWN CODE
+ * Word equations over flattened Concat sequences (see getConcatView), solved
+ * with Nielsen transformations. Used by simplifyConcatEq() when the solver
+ * runs with --nielsen.
+ *
+ * A side is a sequence of tokens: variables (id >= 0) and single characters
+ * (-(c + 1)). nielsenSimplify() cancels equal prefixes and suffixes and
+ * rejects equations whose length or letter counts cannot balance.
+ * nielsenBranches() lists the Nielsen moves on the first tokens of both
+ * sides, nielsenSearch() explores the equations reachable by those moves
+ * breadth first, remembering every equation already seen.
+ */
+
+#define maxNielsenStates 2000
+
+typedef std::pair<T_wordSide, T_wordSide> T_wordEquation;
+
+
+int nielsenSimplify(T_wordSide & lhs, T_wordSide & rhs) {
+  unsigned int i = 0;
+  while (i < lhs.size() && i < rhs.size() && lhs[i] == rhs[i])
+    i++;
+  if (i < lhs.size() && i < rhs.size() && lhs[i] < 0 && rhs[i] < 0)
+    return -1;
+  lhs.erase(lhs.begin(), lhs.begin() + i);
+  rhs.erase(rhs.begin(), rhs.begin() + i);
+
+  while (!lhs.empty() && !rhs.empty() && lhs.back() == rhs.back()) {
+    lhs.pop_back();
+    rhs.pop_back();
+  }
+  if (!lhs.empty() && !rhs.empty() && lhs.back() < 0 && rhs.back() < 0)
+    return -1;
+
+  if (lhs.empty() && rhs.empty())
+    return 0;
+
+  // length: sum over variables of (occurrences left - right) * |x| = chars right - chars left
+  std::map<int, int> varDiff;
+  std::map<int, int> charDiff;
+  int constDiff = 0;
+  for (unsigned int k = 0; k < lhs.size(); k++) {
+    if (lhs[k] >= 0) {
+      varDiff[lhs[k]]++;
+    } else {
+      charDiff[lhs[k]]++;
+      constDiff++;
+    }
+  }
+  for (unsigned int k = 0; k < rhs.size(); k++) {
+    if (rhs[k] >= 0) {
+      varDiff[rhs[k]]--;
+    } else {
+      charDiff[rhs[k]]--;
+      constDiff--;
+    }
+  }
+  bool allZero = true;
+  bool allNonNeg = true;
+  bool allNonPos = true;
+  std::map<int, int>::iterator itor = varDiff.begin();
+  for (; itor != varDiff.end(); itor++) {
+    if (itor->second != 0)
+      allZero = false;
+    if (itor->second < 0)
+      allNonNeg = false;
+    if (itor->second > 0)
+      allNonPos = false;
+  }
+  if ((allNonNeg && constDiff > 0) || (allNonPos && constDiff < 0))
+    return -1;
+  if (allZero) {
+    // the variables cancel out, so must every letter
+    for (itor = charDiff.begin(); itor != charDiff.end(); itor++) {
+      if (itor->second != 0)
+        return -1;
+    }
+  }
+  return 1;
+}
+
+/*
+ * One side empty, the other one made of variables only: all of them are ""
+ */
+bool nielsenSolvedByEmpty(const T_wordSide & lhs, const T_wordSide & rhs) {
+  if (!lhs.empty() && !rhs.empty())
+    return false;
+  const T_wordSide & other = lhs.empty() ? rhs : lhs;
+  for (unsigned int i = 0; i < other.size(); i++) {
+    if (other[i] < 0)
+      return false;
+  }
+  return true;
+}
+
+/*
+ * Moves on x... = y... (simplified, both sides non-empty):
+ *   x = "", y = "", x = y x', y = x y'   (variables)
+ *   x = "", x = a x'                      (x against character a)
+ * Every solution of the equation follows at least one of them.
+ */
+void nielsenBranches(const T_wordSide & lhs, const T_wordSide & rhs, std::vector<T_nielsenMove> & moves) {
+  if (lhs.empty() || rhs.empty())
+    return;
+  int a = lhs[0];
+  int b = rhs[0];
+  if (a >= 0) {
+    T_nielsenMove m;
+    m.var = a;
+    m.prefix = -1;
+    m.toEmpty = true;
+    moves.push_back(m);
+  }
+  if (b >= 0) {
+    T_nielsenMove m;
+    m.var = b;
+    m.prefix = -1;
+    m.toEmpty = true;
+    moves.push_back(m);
+  }
+  if (a >= 0) {
+    T_nielsenMove m;
+    m.var = a;
+    m.prefix = b;
+    m.toEmpty = false;
+    moves.push_back(m);
+  }
+  if (b >= 0) {
+    T_nielsenMove m;
+    m.var = b;
+    m.prefix = a;
+    m.toEmpty = false;
+    moves.push_back(m);
+  }
+}
+
+void nielsenApplySide(const T_wordSide & side, const T_nielsenMove & move, T_wordSide & result) {
+  result.clear();
+  for (unsigned int i = 0; i < side.size(); i++) {
+    if (side[i] != move.var) {
+      result.push_back(side[i]);
+    } else if (!move.toEmpty) {
+      result.push_back(move.prefix);
+      result.push_back(move.var);
+    }
+  }
+}
+
+void nielsenApply(const T_wordSide & lhs, const T_wordSide & rhs, const T_nielsenMove & move, T_wordSide & newLhs, T_wordSide & newRhs) {
+  nielsenApplySide(lhs, move, newLhs);
+  nielsenApplySide(rhs, move, newRhs);
+}
+
+/*
+ * 1: a solved equation is reachable, 0: the equation has no solution,
+ * -1: gave up after maxNielsenStates equations
+ */
+int nielsenSearch(const T_wordSide & lhs, const T_wordSide & rhs) {
+  std::set<T_wordEquation> seen;
+  std::list<T_wordEquation> queue;
+  queue.push_back(T_wordEquation(lhs, rhs));
+  while (!queue.empty()) {
+    T_wordEquation eq = queue.front();
+    queue.pop_front();
+    int res = nielsenSimplify(eq.first, eq.second);
+    if (res == -1)
+      continue;
+    if (res == 0 || nielsenSolvedByEmpty(eq.first, eq.second))
+      return 1;
+    if (seen.find(eq) != seen.end())
+      continue;
+    if ((int) seen.size() >= maxNielsenStates)
+      return -1;
+    seen.insert(eq);
+
+    std::vector<T_nielsenMove> moves;
+    nielsenBranches(eq.first, eq.second, moves);
+    for (unsigned int i = 0; i < moves.size(); i++) {
+      T_wordEquation next;
+      nielsenApply(eq.first, eq.second, moves[i], next.first, next.second);
+      queue.push_back(next);
+    }
+  }
+  return 0;
+}
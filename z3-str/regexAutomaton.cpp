@@ -0,0 +1,818 @@
+#include "strTheory.h"
+
+/*
+ * OWN CODE
+ * Automata for the parsed regexes (see regexParser.cpp).
+ *
+ * getRegexNfa() builds a Thompson NFA per interned regex node, transitions
+ * are labelled by character classes. regexIntersectionWitness() explores
+ * the product of several NFAs breadth first, so it finds the shortest word
+ * accepted by all of them, or proves that there is none.
+ * getRegexMatchIndex() records where a regex matches inside a string
+ * constant, for the Star and Matches reductions over constants.
+ * regexWitnessCandidates() proposes values for strings under Matches.
+ * regexBatchMatch() decides Matches on constants for all regexes at once.
+ */
+
+#define maxNfaStates     10000
+#define maxProductStates 20000
+#define maxWitnessLength 64
+#define minBatchRebuild  4
+
+std::map<const T_regexNode *, const T_regexNfa *> regexNfaCache;
+std::map<std::string, std::pair<int, std::string> > regexIntersectionCache;
+std::map<std::pair<std::string, std::string>, T_regexMatchIndex *> regexMatchIndexCache;
+
+
+int newNfaState(T_regexNfa * nfa){
+  nfa->states.push_back(T_nfaState());
+  return nfa->states.size() - 1;
+}
+
+/*
+ * OWN CODE
+ * Add the fragment for node to nfa, entering at start and leaving at the
+ * returned state. Return -1 if the automaton gets too large.
+ */
+int buildNfaFragment(const T_regexNode * node, T_regexNfa * nfa, int start){
+  if (start < 0 || (int) nfa->states.size() > maxNfaStates){
+    return -1;
+  }
+  switch (node->kind){
+    case regex_Empty:
+    case regex_Begin:
+    case regex_End:
+      return start;
+    case regex_Literal: {
+      int curr = start;
+      for (unsigned int i = 0; i < node->literal.length(); ++ i){
+        unsigned char c = node->literal[i];
+        int next = newNfaState(nfa);
+        nfa->states[curr].trans.push_back(std::make_pair(T_charClass(1, std::make_pair((int) c, (int) c)), next));
+        curr = next;
+      }
+      return curr;
+    }
+    case regex_Any:
+    case regex_Class: {
+      T_charClass cls = (node->kind == regex_Any) ? T_charClass(1, std::make_pair(0, 255)) : node->charClass;
+      int next = newNfaState(nfa);
+      nfa->states[start].trans.push_back(std::make_pair(cls, next));
+      return next;
+    }
+    case regex_Concat: {
+      int curr = start;
+      for (unsigned int i = 0; i < node->children.size() && curr >= 0; ++ i){
+        curr = buildNfaFragment(node->children[i], nfa, curr);
+      }
+      return curr;
+    }
+    case regex_Union: {
+      int end = newNfaState(nfa);
+      for (unsigned int i = 0; i < node->children.size(); ++ i){
+        int branch = newNfaState(nfa);
+        nfa->states[start].eps.push_back(branch);
+        int branchEnd = buildNfaFragment(node->children[i], nfa, branch);
+        if (branchEnd < 0){
+          return -1;
+        }
+        nfa->states[branchEnd].eps.push_back(end);
+      }
+      return end;
+    }
+    case regex_Star:
+    case regex_Plus:
+    case regex_Question: {
+      int loop = newNfaState(nfa);
+      nfa->states[start].eps.push_back(loop);
+      int loopEnd = buildNfaFragment(node->children[0], nfa, loop);
+      if (loopEnd < 0){
+        return -1;
+      }
+      int end = newNfaState(nfa);
+      nfa->states[loopEnd].eps.push_back(end);
+      if (node->kind != regex_Question){
+        nfa->states[loopEnd].eps.push_back(loop);
+      }
+      if (node->kind != regex_Plus){
+        nfa->states[start].eps.push_back(end);
+      }
+      return end;
+    }
+    case regex_Counter: {
+      int curr = start;
+      for (int i = 0; i < node->low && curr >= 0; ++ i){
+        curr = buildNfaFragment(node->children[0], nfa, curr);
+      }
+      if (curr < 0){
+        return -1;
+      }
+      if (node->high == -1){
+        int loop = newNfaState(nfa);
+        nfa->states[curr].eps.push_back(loop);
+        int loopEnd = buildNfaFragment(node->children[0], nfa, loop);
+        if (loopEnd < 0){
+          return -1;
+        }
+        nfa->states[loopEnd].eps.push_back(loop);
+        return loop;
+      }
+      // optional copies, each one may stop the repetition
+      int end = newNfaState(nfa);
+      nfa->states[curr].eps.push_back(end);
+      for (int i = node->low; i < node->high && curr >= 0; ++ i){
+        curr = buildNfaFragment(node->children[0], nfa, curr);
+        if (curr >= 0){
+          nfa->states[curr].eps.push_back(end);
+        }
+      }
+      return curr < 0 ? -1 : end;
+    }
+  }
+  return -1;
+}
+
+/*
+ * OWN CODE
+ * NFA of a parsed regex, NULL if it would be too large
+ */
+const T_regexNfa * getRegexNfa(const T_regexNode * node){
+  std::map<const T_regexNode *, const T_regexNfa *>::iterator it = regexNfaCache.find(node);
+  if (it != regexNfaCache.end()){
+    return it->second;
+  }
+  T_regexNfa * nfa = new T_regexNfa();
+  nfa->start = newNfaState(nfa);
+  nfa->accept = buildNfaFragment(node, nfa, nfa->start);
+  if (nfa->accept < 0){
+#ifdef DEBUGLOG
+    __debugPrint(logFile, ">> getRegexNfa(): %s too large %d\n", node->text.c_str(), __LINE__);
+#endif
+    delete nfa;
+    nfa = NULL;
+  }
+  regexNfaCache[node] = nfa;
+  return nfa;
+}
+
+/*
+ * OWN CODE
+ * Sorted epsilon closure of states
+ */
+std::vector<int> nfaClosure(const T_regexNfa * nfa, const std::set<int> & states){
+  std::set<int> closure(states);
+  std::vector<int> todo(states.begin(), states.end());
+  while (! todo.empty()){
+    int s = todo.back();
+    todo.pop_back();
+    for (unsigned int i = 0; i < nfa->states[s].eps.size(); ++ i){
+      if (closure.insert(nfa->states[s].eps[i]).second){
+        todo.push_back(nfa->states[s].eps[i]);
+      }
+    }
+  }
+  return std::vector<int>(closure.begin(), closure.end());
+}
+
+/*
+ * OWN CODE
+ * States reached from the states curr on the character c
+ */
+std::vector<int> nfaStep(const T_regexNfa * nfa, const std::vector<int> & curr, int c){
+  std::set<int> moved;
+  for (unsigned int k = 0; k < curr.size(); ++ k){
+    const T_nfaState & state = nfa->states[curr[k]];
+    for (unsigned int l = 0; l < state.trans.size(); ++ l){
+      if (charClassContains(state.trans[l].first, c)){
+        moved.insert(state.trans[l].second);
+      }
+    }
+  }
+  return nfaClosure(nfa, moved);
+}
+
+typedef std::vector<std::vector<int> > T_productState;
+
+/*
+ * OWN CODE
+ * Preferred character of [first, last]: a letter, a digit, printable, anything
+ */
+int nfaCellRepresentative(int first, int last){
+  const char * preferred[] = { "az", "AZ", "09", " ~" };
+  for (int i = 0; i < 4; ++ i){
+    int low = std::max(first, (int) preferred[i][0]);
+    if (low <= std::min(last, (int) preferred[i][1])){
+      return low;
+    }
+  }
+  return first;
+}
+
+/*
+ * OWN CODE
+ * Split 1..255 into cells whose characters behave the same in every NFA
+ * from curr, as (first, last) pairs. '\0' is never used.
+ */
+std::vector<std::pair<int, int> > productCells(const std::vector<const T_regexNfa *> & nfas, const T_productState & curr){
+  std::set<int> bounds;
+  bounds.insert(1);
+  bounds.insert(256);
+  for (unsigned int i = 0; i < nfas.size(); ++ i){
+    for (unsigned int j = 0; j < curr[i].size(); ++ j){
+      const T_nfaState & state = nfas[i]->states[curr[i][j]];
+      for (unsigned int k = 0; k < state.trans.size(); ++ k){
+        for (unsigned int r = 0; r < state.trans[k].first.size(); ++ r){
+          bounds.insert(std::max(1, state.trans[k].first[r].first));
+          bounds.insert(state.trans[k].first[r].second + 1);
+        }
+      }
+    }
+  }
+  std::vector<std::pair<int, int> > cells;
+  std::set<int>::iterator b = bounds.begin();
+  for (int first = *b; ++ b != bounds.end() && first <= 255; first = *b){
+    cells.push_back(std::make_pair(first, *b - 1));
+  }
+  return cells;
+}
+
+/*
+ * OWN CODE
+ * Move every NFA of curr on c, false if one of them gets stuck
+ */
+bool productStep(const std::vector<const T_regexNfa *> & nfas, const T_productState & curr, int c, T_productState & next){
+  next.clear();
+  for (unsigned int i = 0; i < nfas.size(); ++ i){
+    std::set<int> moved;
+    for (unsigned int j = 0; j < curr[i].size(); ++ j){
+      const T_nfaState & state = nfas[i]->states[curr[i][j]];
+      for (unsigned int k = 0; k < state.trans.size(); ++ k){
+        if (charClassContains(state.trans[k].first, c)){
+          moved.insert(state.trans[k].second);
+        }
+      }
+    }
+    if (moved.empty()){
+      return false;
+    }
+    next.push_back(nfaClosure(nfas[i], moved));
+  }
+  return true;
+}
+
+bool productAccepting(const std::vector<const T_regexNfa *> & nfas, const T_productState & curr){
+  for (unsigned int i = 0; i < nfas.size(); ++ i){
+    if (! std::binary_search(curr[i].begin(), curr[i].end(), nfas[i]->accept)){
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * OWN CODE
+ * NFAs of the distinct regexes and their product start state, false if one is unknown
+ */
+bool productInit(const std::vector<std::string> & regexes, std::vector<const T_regexNfa *> & nfas, T_productState & init){
+  for (unsigned int i = 0; i < regexes.size(); ++ i){
+    const T_regexNode * ast = getRegexAst(regexes[i]);
+    const T_regexNfa * nfa = (ast == NULL) ? NULL : getRegexNfa(ast);
+    if (nfa == NULL){
+      return false;
+    }
+    nfas.push_back(nfa);
+    std::set<int> s;
+    s.insert(nfa->start);
+    init.push_back(nfaClosure(nfa, s));
+  }
+  return true;
+}
+
+/*
+ * OWN CODE
+ * Return 1 and the shortest word accepted by every regex in witness,
+ * 0 if the intersection is empty, -1 if unknown (invalid or too large).
+ * '\0' is never used, string constants cannot hold it.
+ */
+int regexIntersectionWitness(const std::vector<std::string> & regexes, std::string & witness){
+  witness = "";
+  std::vector<std::string> sorted(regexes);
+  std::sort(sorted.begin(), sorted.end());
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+  std::string key = "";
+  for (unsigned int i = 0; i < sorted.size(); ++ i){
+    key += sorted[i] + '\0';
+  }
+  std::map<std::string, std::pair<int, std::string> >::iterator cacheIt = regexIntersectionCache.find(key);
+  if (cacheIt != regexIntersectionCache.end()){
+    witness = cacheIt->second.second;
+    return cacheIt->second.first;
+  }
+
+  int result = 0;
+  std::vector<const T_regexNfa *> nfas;
+  std::map<T_productState, int> seen;
+  std::vector<T_productState> queue;
+  std::vector<int> parent;
+  std::vector<char> via;
+  T_productState init;
+  if (! productInit(sorted, nfas, init)){
+    result = -1;
+  } else {
+    seen[init] = 0;
+    queue.push_back(init);
+    parent.push_back(-1);
+    via.push_back(0);
+  }
+
+  for (unsigned int idx = 0; result == 0 && idx < queue.size(); ++ idx){
+    T_productState curr = queue[idx];
+    if (productAccepting(nfas, curr)){
+      for (int p = idx; parent[p] != -1; p = parent[p]){
+        witness = via[p] + witness;
+      }
+      result = 1;
+      break;
+    }
+    std::vector<std::pair<int, int> > cells = productCells(nfas, curr);
+    for (unsigned int i = 0; i < cells.size(); ++ i){
+      int c = cells[i].first;
+      T_productState next;
+      if (! productStep(nfas, curr, c, next) || seen.find(next) != seen.end()){
+        continue;
+      }
+      if ((int) queue.size() >= maxProductStates){
+        result = -1;
+        break;
+      }
+      seen[next] = queue.size();
+      queue.push_back(next);
+      parent.push_back(idx);
+      via.push_back((char) c);
+    }
+  }
+
+#ifdef DEBUGLOG
+  __debugPrint(logFile, ">> regexIntersectionWitness(): %d regexes, %d product states => %d\n",
+      (int) sorted.size(), (int) queue.size(), result);
+#endif
+  regexIntersectionCache[key] = std::make_pair(result, witness);
+  return result;
+}
+
+/*
+ * OWN CODE
+ * Lengths of the words accepted by regexStr, as a union of arithmetic
+ * progressions (base, period): period 0 is the single length base,
+ * otherwise every base + k * period. Return false if unknown.
+ *
+ * Only the number of characters matters, so the NFA is run as a unary
+ * automaton: the sets of states reached after k characters repeat after
+ * a while, and the repetition gives the period.
+ */
+bool getRegexLengthSet(const std::string & regexStr, std::vector<std::pair<int, int> > & lengths){
+  lengths.clear();
+  const T_regexNode * ast = getRegexAst(regexStr);
+  const T_regexNfa * nfa = (ast == NULL) ? NULL : getRegexNfa(ast);
+  if (nfa == NULL){
+    return false;
+  }
+
+  std::map<std::vector<int>, int> index;
+  std::vector<bool> accepted;
+  std::set<int> s;
+  s.insert(nfa->start);
+  std::vector<int> curr = nfaClosure(nfa, s);
+  int loopStart = -1;
+  while (! curr.empty()){
+    std::map<std::vector<int>, int>::iterator it = index.find(curr);
+    if (it != index.end()){
+      loopStart = it->second;
+      break;
+    }
+    if ((int) accepted.size() >= maxNfaStates){
+      return false;
+    }
+    index[curr] = accepted.size();
+    accepted.push_back(std::binary_search(curr.begin(), curr.end(), nfa->accept));
+    std::set<int> moved;
+    for (unsigned int j = 0; j < curr.size(); ++ j){
+      const T_nfaState & state = nfa->states[curr[j]];
+      for (unsigned int k = 0; k < state.trans.size(); ++ k){
+        // a transition on '\0' only can never be taken
+        const T_charClass & cls = state.trans[k].first;
+        if (! cls.empty() && cls.back().second >= 1){
+          moved.insert(state.trans[k].second);
+        }
+      }
+    }
+    curr = nfaClosure(nfa, moved);
+  }
+
+  int size = accepted.size();
+  if (loopStart < 0){
+    for (int i = 0; i < size; ++ i){
+      if (accepted[i]){
+        lengths.push_back(std::make_pair(i, 0));
+      }
+    }
+    return true;
+  }
+  bool allAccepted = true;
+  for (int i = loopStart; i < size; ++ i){
+    allAccepted = allAccepted && accepted[i];
+  }
+  if (allAccepted){
+    // every length from loopStart on
+    while (loopStart > 0 && accepted[loopStart - 1]){
+      -- loopStart;
+    }
+    for (int i = 0; i < loopStart; ++ i){
+      if (accepted[i]){
+        lengths.push_back(std::make_pair(i, 0));
+      }
+    }
+    lengths.push_back(std::make_pair(loopStart, 1));
+    return true;
+  }
+  for (int i = 0; i < size; ++ i){
+    if (accepted[i]){
+      lengths.push_back(std::make_pair(i, (i >= loopStart) ? size - loopStart : 0));
+    }
+  }
+#ifdef DEBUGLOG
+  __debugPrint(logFile, ">> getRegexLengthSet(): %s => %d progressions, period %d\n", regexStr.c_str(), (int) lengths.size(), size - loopStart);
+#endif
+  return true;
+}
+
+/*
+ * OWN CODE
+ * Shared match-position index of regexStr over constStr, NULL if unknown
+ * (invalid or too large)
+ */
+T_regexMatchIndex * getRegexMatchIndex(const std::string & regexStr, const std::string & constStr){
+  std::pair<std::string, std::string> key(regexStr, constStr);
+  std::map<std::pair<std::string, std::string>, T_regexMatchIndex *>::iterator it = regexMatchIndexCache.find(key);
+  if (it != regexMatchIndexCache.end()){
+    return it->second;
+  }
+  const T_regexNode * ast = getRegexAst(regexStr);
+  const T_regexNfa * nfa = (ast == NULL) ? NULL : getRegexNfa(ast);
+  T_regexMatchIndex * index = NULL;
+  if (nfa != NULL){
+    index = new T_regexMatchIndex();
+    index->nfa = nfa;
+    index->constStr = constStr;
+    index->ends.resize(constStr.length() + 1);
+    index->known.resize(constStr.length() + 1, false);
+  }
+  regexMatchIndexCache[key] = index;
+  return index;
+}
+
+/*
+ * OWN CODE
+ * Sorted ends j of the matches constStr[begin, j), one NFA run per begin
+ */
+const std::vector<int> & regexMatchEnds(T_regexMatchIndex * index, int begin){
+  if (index->known[begin]){
+    return index->ends[begin];
+  }
+  const T_regexNfa * nfa = index->nfa;
+  std::vector<int> & ends = index->ends[begin];
+  std::set<int> s;
+  s.insert(nfa->start);
+  std::vector<int> curr = nfaClosure(nfa, s);
+  for (int j = begin; ! curr.empty(); ++ j){
+    if (std::binary_search(curr.begin(), curr.end(), nfa->accept)){
+      ends.push_back(j);
+    }
+    if (j == (int) index->constStr.length()){
+      break;
+    }
+    curr = nfaStep(nfa, curr, (unsigned char) index->constStr[j]);
+  }
+  index->known[begin] = true;
+  return ends;
+}
+
+/*
+ * OWN CODE
+ */
+bool regexMatchesSubstr(T_regexMatchIndex * index, int begin, int end){
+  const std::vector<int> & ends = regexMatchEnds(index, begin);
+  return std::binary_search(ends.begin(), ends.end(), end);
+}
+
+/*
+ * OWN CODE
+ * Words accepted by every regex in regexes, as value candidates for a
+ * string under these Matches atoms: the smallest word of each of the first
+ * lengths the product accepts, then one printable word of each such length
+ * drawn uniformly at random (fixed seed) by counting the accepted words.
+ * Return false if unknown.
+ */
+bool regexWitnessCandidates(const std::vector<std::string> & regexes, int maxCount, std::vector<std::string> & words){
+  words.clear();
+  std::vector<const T_regexNfa *> nfas;
+  T_productState init;
+  if (! productInit(regexes, nfas, init)){
+    return false;
+  }
+
+  // layers[d]: states reached by words of length d, with the smallest such word
+  std::vector<std::map<T_productState, std::string> > layers(1);
+  layers[0][init] = "";
+  std::vector<int> lengths;
+  int total = 1;
+  for (int d = 0; d <= maxWitnessLength && ! layers[d].empty() && (int) lengths.size() < maxCount; ++ d){
+    std::string best = "";
+    bool found = false;
+    std::map<T_productState, std::string>::iterator it = layers[d].begin();
+    for (; it != layers[d].end(); ++ it){
+      if (productAccepting(nfas, it->first) && (! found || it->second < best)){
+        best = it->second;
+        found = true;
+      }
+    }
+    if (found){
+      words.push_back(best);
+      lengths.push_back(d);
+    }
+    if (d == maxWitnessLength || (int) lengths.size() >= maxCount){
+      break;
+    }
+    layers.push_back(std::map<T_productState, std::string>());
+    for (it = layers[d].begin(); it != layers[d].end() && total < maxProductStates; ++ it){
+      std::vector<std::pair<int, int> > cells = productCells(nfas, it->first);
+      for (unsigned int i = 0; i < cells.size(); ++ i){
+        std::string word = it->second + (char) nfaCellRepresentative(cells[i].first, cells[i].second);
+        T_productState next;
+        if (! productStep(nfas, it->first, cells[i].first, next)){
+          continue;
+        }
+        std::map<T_productState, std::string>::iterator old = layers[d + 1].find(next);
+        if (old == layers[d + 1].end()){
+          layers[d + 1][next] = word;
+          ++ total;
+        } else if (word < old->second){
+          old->second = word;
+        }
+      }
+    }
+  }
+
+  unsigned int seed = 1;
+  for (unsigned int l = 0; l < lengths.size(); ++ l){
+    int len = lengths[l];
+    // count[d][state]: printable words of length len - d leading from state to acceptance
+    std::vector<std::map<T_productState, double> > count(len + 1);
+    for (int d = len; d >= 0; -- d){
+      std::map<T_productState, std::string>::iterator it = layers[d].begin();
+      for (; it != layers[d].end(); ++ it){
+        double n = 0;
+        if (d == len){
+          n = productAccepting(nfas, it->first) ? 1 : 0;
+        } else {
+          std::vector<std::pair<int, int> > cells = productCells(nfas, it->first);
+          for (unsigned int i = 0; i < cells.size(); ++ i){
+            int printable = std::min(cells[i].second, 126) - std::max(cells[i].first, 32) + 1;
+            T_productState next;
+            if (printable > 0 && productStep(nfas, it->first, cells[i].first, next) && count[d + 1].find(next) != count[d + 1].end()){
+              n += printable * count[d + 1][next];
+            }
+          }
+        }
+        count[d][it->first] = n;
+      }
+    }
+    if (count[0][init] <= 0){
+      continue;
+    }
+    std::string word = "";
+    T_productState curr = init;
+    for (int d = 0; d < len; ++ d){
+      seed = seed * 1103515245 + 12345;
+      double pick = (seed >> 8) / 16777216.0 * count[d][curr];
+      std::vector<std::pair<int, int> > cells = productCells(nfas, curr);
+      for (unsigned int i = 0; i < cells.size(); ++ i){
+        int low = std::max(cells[i].first, 32);
+        int printable = std::min(cells[i].second, 126) - low + 1;
+        T_productState next;
+        if (printable <= 0 || ! productStep(nfas, curr, cells[i].first, next) || count[d + 1].find(next) == count[d + 1].end()){
+          continue;
+        }
+        double weight = printable * count[d + 1][next];
+        if (pick < weight || i + 1 == cells.size()){
+          word += (char) (low + (int) (pick / count[d + 1][next]) % printable);
+          curr = next;
+          break;
+        }
+        pick -= weight;
+      }
+    }
+    if ((int) word.length() == len && std::find(words.begin(), words.end(), word) == words.end()){
+      words.push_back(word);
+    }
+  }
+#ifdef DEBUGLOG
+  __debugPrint(logFile, ">> regexWitnessCandidates(): %d regexes, %d product states => %d words\n",
+      (int) regexes.size(), total, (int) words.size());
+#endif
+  return true;
+}
+
+/*
+ * OWN CODE
+ * Batch matcher for Matches on string constants. Every regex seen goes
+ * into one merged NFA, which is run as a DFA built lazily over byte
+ * classes (bytes no transition tells apart share a class). A single scan
+ * of a constant then decides it against all the regexes at once, and the
+ * answers are cached.
+ *
+ * A new regex is not merged right away: it is run on its own NFA until the
+ * regexes waiting outside the merged NFA are as many as those in it. k
+ * regexes therefore cost O(log k) rebuilds instead of one per regex.
+ */
+typedef struct _T_batchMatcher
+{
+    std::vector<std::string> regexes;
+    std::map<std::string, int> regexId;
+    std::vector<const T_regexNfa *> nfas;
+    int built;                           // nfas[0, built) are in merged
+    T_regexNfa merged;
+    std::vector<int> acceptOf;           // merged state -> regex id, -1 if not accepting
+    int byteClass[256];
+    std::vector<int> classChar;          // a byte of each class
+    std::map<std::vector<int>, int> dfaIndex;
+    std::vector<std::vector<int> > dfaStates;
+    std::vector<std::vector<int> > dfaTrans;   // -1: not built yet, -2: dead
+    std::vector<std::vector<int> > dfaAccepts; // sorted regex ids
+} T_batchMatcher;
+
+T_batchMatcher batchMatcher;
+std::map<std::pair<std::string, std::string>, bool> batchMatchCache;
+
+int batchDfaState(const std::vector<int> & states){
+  std::map<std::vector<int>, int>::iterator it = batchMatcher.dfaIndex.find(states);
+  if (it != batchMatcher.dfaIndex.end()){
+    return it->second;
+  }
+  if ((int) batchMatcher.dfaStates.size() >= maxProductStates){
+    return -1;
+  }
+  std::vector<int> accepts;
+  for (unsigned int i = 0; i < states.size(); ++ i){
+    if (batchMatcher.acceptOf[states[i]] >= 0){
+      accepts.push_back(batchMatcher.acceptOf[states[i]]);
+    }
+  }
+  std::sort(accepts.begin(), accepts.end());
+  int id = batchMatcher.dfaStates.size();
+  batchMatcher.dfaIndex[states] = id;
+  batchMatcher.dfaStates.push_back(states);
+  batchMatcher.dfaTrans.push_back(std::vector<int>(batchMatcher.classChar.size(), -1));
+  batchMatcher.dfaAccepts.push_back(accepts);
+  return id;
+}
+
+/*
+ * OWN CODE
+ * Merge the NFAs of all registered regexes, recompute the byte classes
+ * and drop the DFA built so far
+ */
+void batchMatcherBuild(){
+  T_batchMatcher & m = batchMatcher;
+  m.merged.states.clear();
+  m.acceptOf.clear();
+  std::set<int> starts;
+  for (unsigned int r = 0; r < m.nfas.size(); ++ r){
+    int offset = m.merged.states.size();
+    for (unsigned int i = 0; i < m.nfas[r]->states.size(); ++ i){
+      T_nfaState state = m.nfas[r]->states[i];
+      for (unsigned int k = 0; k < state.trans.size(); ++ k){
+        state.trans[k].second += offset;
+      }
+      for (unsigned int k = 0; k < state.eps.size(); ++ k){
+        state.eps[k] += offset;
+      }
+      m.merged.states.push_back(state);
+      m.acceptOf.push_back(-1);
+    }
+    m.acceptOf[offset + m.nfas[r]->accept] = r;
+    starts.insert(offset + m.nfas[r]->start);
+  }
+
+  std::set<int> bounds;
+  bounds.insert(0);
+  for (unsigned int i = 0; i < m.merged.states.size(); ++ i){
+    for (unsigned int k = 0; k < m.merged.states[i].trans.size(); ++ k){
+      const T_charClass & cls = m.merged.states[i].trans[k].first;
+      for (unsigned int r = 0; r < cls.size(); ++ r){
+        bounds.insert(cls[r].first);
+        bounds.insert(cls[r].second + 1);
+      }
+    }
+  }
+  m.classChar.clear();
+  for (int c = 0; c < 256; ++ c){
+    if (bounds.find(c) != bounds.end()){
+      m.classChar.push_back(c);
+    }
+    m.byteClass[c] = m.classChar.size() - 1;
+  }
+
+  m.dfaIndex.clear();
+  m.dfaStates.clear();
+  m.dfaTrans.clear();
+  m.dfaAccepts.clear();
+  batchDfaState(nfaClosure(&m.merged, starts));
+  m.built = m.nfas.size();
+}
+
+/*
+ * OWN CODE
+ * Next DFA state on byte class cls, -2 if dead, -1 if the DFA gets too large
+ */
+int batchDfaStep(int state, int cls){
+  T_batchMatcher & m = batchMatcher;
+  if (m.dfaTrans[state][cls] != -1){
+    return m.dfaTrans[state][cls];
+  }
+  int c = m.classChar[cls];
+  std::set<int> moved;
+  const std::vector<int> & curr = m.dfaStates[state];
+  for (unsigned int j = 0; j < curr.size(); ++ j){
+    const T_nfaState & nfaState = m.merged.states[curr[j]];
+    for (unsigned int k = 0; k < nfaState.trans.size(); ++ k){
+      if (charClassContains(nfaState.trans[k].first, c)){
+        moved.insert(nfaState.trans[k].second);
+      }
+    }
+  }
+  int next = moved.empty() ? -2 : batchDfaState(nfaClosure(&m.merged, moved));
+  if (next != -1){
+    m.dfaTrans[state][cls] = next;
+  }
+  return next;
+}
+
+/*
+ * OWN CODE
+ * 1 if constStr matches regexStr, 0 if not, -1 if unknown (invalid or too large)
+ */
+int regexBatchMatch(const std::string & regexStr, const std::string & constStr){
+  std::pair<std::string, std::string> key(regexStr, constStr);
+  std::map<std::pair<std::string, std::string>, bool>::iterator it = batchMatchCache.find(key);
+  if (it != batchMatchCache.end()){
+    return it->second ? 1 : 0;
+  }
+  T_batchMatcher & m = batchMatcher;
+  if (m.regexId.find(regexStr) == m.regexId.end()){
+    const T_regexNode * ast = getRegexAst(regexStr);
+    const T_regexNfa * nfa = (ast == NULL) ? NULL : getRegexNfa(ast);
+    if (nfa == NULL){
+      return -1;
+    }
+    m.regexId[regexStr] = m.regexes.size();
+    m.regexes.push_back(regexStr);
+    m.nfas.push_back(nfa);
+  }
+  int id = m.regexId[regexStr];
+  if (id >= m.built){
+    if ((int) m.nfas.size() - m.built < std::max(m.built, minBatchRebuild)){
+      // not merged yet: simulate its own NFA
+      std::set<int> s;
+      s.insert(m.nfas[id]->start);
+      std::vector<int> curr = nfaClosure(m.nfas[id], s);
+      for (unsigned int i = 0; i < constStr.length() && ! curr.empty(); ++ i){
+        curr = nfaStep(m.nfas[id], curr, (unsigned char) constStr[i]);
+      }
+      bool match = std::binary_search(curr.begin(), curr.end(), m.nfas[id]->accept);
+      batchMatchCache[key] = match;
+      return match ? 1 : 0;
+    }
+    batchMatcherBuild();
+  }
+
+  // a full DFA is dropped and rebuilt for this constant alone, once
+  int state = -1;
+  for (int attempt = 0; attempt < 2 && state == -1; ++ attempt){
+    if (attempt > 0){
+      batchMatcherBuild();
+    }
+    state = 0;
+    for (unsigned int i = 0; i < constStr.length() && state >= 0; ++ i){
+      state = batchDfaStep(state, m.byteClass[(unsigned char) constStr[i]]);
+    }
+  }
+  if (state == -1){
+    return -1;
+  }
+  for (int r = 0; r < m.built; ++ r){
+    bool match = state >= 0 && std::binary_search(m.dfaAccepts[state].begin(), m.dfaAccepts[state].end(), (int) r);
+    batchMatchCache[std::make_pair(m.regexes[r], constStr)] = match;
+  }
+  return batchMatchCache[key] ? 1 : 0;
+}
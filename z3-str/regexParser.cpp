@@ -2,400 +2,999 @@
 
 /*
  * OWN CODE
- * Parse for Regex with form <set>
+ * Regex front end.
+ *
+ * A pattern is parsed once by a recursive-descent parser into a tree of
+ * T_regexNode. Nodes are interned by (kind, source text), and whole patterns
+ * are cached in regexAstCache, so reductions that see the same pattern
+ * again (Star unrolling, Matches on several variables, ...) reuse the tree.
+ *
+ * The tree does not depend on a Z3 context. regex_parse() instantiates it:
+ * every call makes fresh internal variables, as each occurrence of a regex
+ * has to be free to match a different string.
+ * Wide classes and counters over anything but a literal become one variable
+ * under a Matches atom that the automaton decides (mkRegexAtomVar).
+ *
+ * Grammar:
+ *   union  := concat ('|' concat)*
+ *   concat := repeat*
+ *   repeat := atom ('*' | '+' | '?' | '{n}' | '{n,}' | '{n,m}')*
+ *   atom   := '(' union ')' | '[' class ']' | '.' | '^' | '$' | '\' char | char
+ *
+ * '^' and '$' are anchors, as in boost: Matches() is a whole-string match,
+ * so an anchor is accepted only where it is a no-op (regexAnchorsValid) and
+ * is dropped by the simplifier. Anywhere else the pattern is rejected.
  */
-Z3_ast parseBraces(Z3_theory t, std::string strInBraces, Z3_ast & assert){
-  assert = NULL;
-  if (strInBraces[0] != '[' || strInBraces[strInBraces.length() - 1] != ']'){
-#ifdef DEBUGLOG
-   __debugPrint(logFile, ">> parseBraces(): %s invalid regex-brace Type %d\n", strInBraces.c_str(), __LINE__);
-#endif
-    return NULL;
+
+std::map<std::string, const T_regexNode *> regexNodeTable;
+std::map<std::string, const T_regexNode *> regexAstCache;
+
+// a counter over a literal is spelled out up to this many characters
+const unsigned int maxFoldedCounterLiteral = 4096;
+// a class with more characters (or more outside it) is a Matches atom
+const int maxClassDisjuncts = 32;
+
+
+/*
+ * OWN CODE
+ * Return the unique node equal to node, node itself is consumed
+ */
+const T_regexNode * internRegexNode(T_regexNode * node){
+  std::stringstream ss;
+  ss << (int) node->kind << ":" << node->text;
+  std::string key = ss.str();
+  std::map<std::string, const T_regexNode *>::iterator it = regexNodeTable.find(key);
+  if (it != regexNodeTable.end()){
+    delete node;
+    return it->second;
   }
-  strInBraces = strInBraces.substr(1, strInBraces.length() - 2);
-    
-  Z3_context ctx = Z3_theory_get_context(t);
-  std::set<Z3_ast> item_set;
-  Z3_ast character = my_mk_internal_string_var(t);
-  bool startsWithCaret = false;
-  if (strInBraces[0] == '^'){
-    startsWithCaret = true;
-    strInBraces = strInBraces.substr(1);
-  }
-  //TODO process for special character in the dictionary 
-  for (unsigned int id = 0; id < strInBraces.length(); ++ id){
-    if (strInBraces[id] == '-' && id < strInBraces.length() - 1 && id > 0){
-    	char charTemp;
-      //becareful with 4 below lines
-      for (charTemp = strInBraces[id - 1] + 1; charTemp <= strInBraces[id + 1]; ++ charTemp){
-        strInBraces[id - 1] = charTemp;
-        item_set.insert(my_mk_str_value(t, strInBraces.substr(id - 1, 1).c_str()));
-      }
-      ++id;
+  regexNodeTable[key] = node;
+  return node;
+}
+
+T_regexNode * newRegexNode(T_regexKind kind, const std::string & regexStr, unsigned int begin, unsigned int end){
+  T_regexNode * node = new T_regexNode();
+  node->kind = kind;
+  node->text = regexStr.substr(begin, end - begin);
+  node->low = 0;
+  node->high = -1;
+  return node;
+}
+
+/*
+ * OWN CODE
+ * Character class operations. A class is a sorted vector of disjoint,
+ * non-adjacent ranges over 0..255, so membership is a binary search and
+ * union / intersection / complement are linear merges.
+ */
+void charClassAddRange(T_charClass & cls, int first, int second){
+  if (first > second){
+    return;
+  }
+  T_charClass single(1, std::make_pair(first, second));
+  cls = charClassUnion(cls, single);
+}
+
+bool charClassContains(const T_charClass & cls, int c){
+  // first range starting after c, the candidate is the one before it
+  T_charClass::const_iterator it = std::upper_bound(cls.begin(), cls.end(), std::make_pair(c, INT_MAX));
+  if (it == cls.begin()){
+    return false;
+  }
+  -- it;
+  return it->first <= c && c <= it->second;
+}
+
+int charClassSize(const T_charClass & cls){
+  int size = 0;
+  for (unsigned int i = 0; i < cls.size(); ++ i){
+    size += cls[i].second - cls[i].first + 1;
+  }
+  return size;
+}
+
+T_charClass charClassUnion(const T_charClass & a, const T_charClass & b){
+  T_charClass result;
+  unsigned int i = 0;
+  unsigned int j = 0;
+  while (i < a.size() || j < b.size()){
+    std::pair<int, int> next;
+    if (j >= b.size() || (i < a.size() && a[i].first <= b[j].first)){
+      next = a[i ++];
     } else {
-      item_set.insert(my_mk_str_value(t, strInBraces.substr(id, 1).c_str()));
-    }
-  }
-  std::set<Z3_ast>::iterator it;
-  Z3_ast * or_items = new Z3_ast [item_set.size()];
-  int pos; 
-  for (it = item_set.begin(), pos = 0; it != item_set.end(); ++ it, ++ pos){
-    or_items[pos] = Z3_mk_eq(ctx, character, *it); 
-  }
-  Z3_ast result = character; assert = Z3_mk_or(ctx, pos, or_items);
-  if (startsWithCaret){
-    assert = Z3_mk_not(ctx, assert);  
-  }    
-  Z3_ast charLen_eq_one = Z3_mk_eq(ctx, mk_int(ctx, 1), mk_length(t, character));
-  assert = mk_2_and(t, charLen_eq_one, assert);
- 
-  delete[] or_items;
+      next = b[j ++];
+    }
+    if (result.size() > 0 && next.first <= result.back().second + 1){
+      result.back().second = std::max(result.back().second, next.second);
+    } else {
+      result.push_back(next);
+    }
+  }
+  return result;
+}
+
+T_charClass charClassIntersect(const T_charClass & a, const T_charClass & b){
+  T_charClass result;
+  unsigned int i = 0;
+  unsigned int j = 0;
+  while (i < a.size() && j < b.size()){
+    int first = std::max(a[i].first, b[j].first);
+    int second = std::min(a[i].second, b[j].second);
+    if (first <= second){
+      result.push_back(std::make_pair(first, second));
+    }
+    if (a[i].second < b[j].second){
+      ++ i;
+    } else {
+      ++ j;
+    }
+  }
+  return result;
+}
+
+T_charClass charClassComplement(const T_charClass & a){
+  T_charClass result;
+  int next = 0;
+  for (unsigned int i = 0; i < a.size(); ++ i){
+    if (a[i].first > next){
+      result.push_back(std::make_pair(next, a[i].first - 1));
+    }
+    next = a[i].second + 1;
+  }
+  if (next <= 255){
+    result.push_back(std::make_pair(next, 255));
+  }
   return result;
 }
 
 /*
  * OWN CODE
- * parse for regex with form <question>
+ * Class of the escapes \d \w \s \D \W \S
  */
-Z3_ast parseQuestion(Z3_theory t, std::string regexStr, Z3_ast & breakDownAssert){
-  if (regexStr[regexStr.length() - 1] != '?'){
-#ifdef DEBUGLOG
-      __debugPrint(logFile, ">> parseQuestion(): %s invalid regex-question Type %d\n", regexStr.c_str(), __LINE__);
-#endif
-    return NULL;
+bool getEscapeClass(char c, T_charClass & cls){
+  cls.clear();
+  switch (c){
+    case 'd': case 'D':
+      charClassAddRange(cls, '0', '9');
+      break;
+    case 'w': case 'W':
+      charClassAddRange(cls, '0', '9');
+      charClassAddRange(cls, 'a', 'z');
+      charClassAddRange(cls, 'A', 'Z');
+      charClassAddRange(cls, '_', '_');
+      break;
+    case 's': case 'S':
+      charClassAddRange(cls, ' ', ' ');
+      charClassAddRange(cls, '\t', '\r');  // \t \n \v \f \r
+      break;
+    default:
+      return false;
+  }
+  if (c == 'D' || c == 'W' || c == 'S'){
+    cls = charClassComplement(cls);
+  }
+  return true;
+}
+
+/*
+ * OWN CODE
+ * The character denoted by "\c" when c is not a class escape
+ */
+char getEscapedChar(char c){
+  switch (c){
+    case 'n': return '\n';
+    case 't': return '\t';
+    case 'r': return '\r';
+    case 'f': return '\f';
+    case 'v': return '\v';
+    default: return c;
   }
-  regexStr = regexStr.substr(0, regexStr.length() - 1);
-  
-  Z3_context ctx = Z3_theory_get_context(t);
-  Z3_ast result = my_mk_internal_string_var(t);
-  
-  Z3_ast assert = NULL;
-  Z3_ast exist = regex_parse(t, regexStr, assert);
-  assert = mk_2_and(t, assert, Z3_mk_eq(ctx, result, exist));
-  Z3_ast notExist = my_mk_str_value(t, "");
-  breakDownAssert = mk_2_or(t, assert, Z3_mk_eq(ctx, result, notExist));
-  
-  return result;
 }
 
+const T_regexNode * parseRegexUnion(const std::string & regexStr, unsigned int & pos);
 
 /*
  * OWN CODE
- * parse for regex with form <star>
+ * parse for regex with form <set>, pos is after '['
  */
-Z3_ast parseStar(Z3_theory t, std::string regexStr, Z3_ast & breakDownAssert){
-  if (regexStr[regexStr.length() - 1] != '*'){
+const T_regexNode * parseRegexClass(const std::string & regexStr, unsigned int & pos){
+  unsigned int begin = pos - 1;
+  T_regexNode * node = newRegexNode(regex_Class, regexStr, begin, begin);
+  bool negated = false;
+  if (pos < regexStr.length() && regexStr[pos] == '^'){
+    negated = true;
+    ++ pos;
+  }
+  bool first = true;
+  while (pos < regexStr.length() && (regexStr[pos] != ']' || first)){
+    first = false;
+    unsigned char low = regexStr[pos];
+    if (low == '\\' && pos + 1 < regexStr.length()){
+      T_charClass escClass;
+      if (getEscapeClass(regexStr[pos + 1], escClass)){
+        node->charClass = charClassUnion(node->charClass, escClass);
+        pos += 2;
+        continue;
+      }
+      low = getEscapedChar(regexStr[pos + 1]);
+      ++ pos;
+    }
+    ++ pos;
+    unsigned char high = low;
+    if (pos + 1 < regexStr.length() && regexStr[pos] == '-' && regexStr[pos + 1] != ']'){
+      high = regexStr[pos + 1];
+      pos += 2;
+      if (high == '\\' && pos < regexStr.length()){
+        high = getEscapedChar(regexStr[pos]);
+        ++ pos;
+      }
+    }
+    charClassAddRange(node->charClass, low, high);
+  }
+  if (pos >= regexStr.length()){
 #ifdef DEBUGLOG
-      __debugPrint(logFile, ">> parseStar(): %s invalid regex-star Type %d\n", regexStr.c_str(), __LINE__);
+    __debugPrint(logFile, ">> parseRegexClass(): %s unclosed [ %d\n", regexStr.c_str(), __LINE__);
 #endif
+    delete node;
     return NULL;
   }
-  regexStr = regexStr.substr(0, regexStr.length() - 1);
-  
-  Z3_context ctx = Z3_theory_get_context(t);
-  Z3_ast intVar = my_mk_internal_int_var(t);
-  Z3_ast result = mk_star(t, my_mk_regex_value(t, regexStr.c_str()), intVar, breakDownAssert);
-  breakDownAssert = Z3_mk_ge(ctx, intVar, mk_int(ctx, 0));
-  
-  return result;
+  ++ pos;
+  node->text = regexStr.substr(begin, pos - begin);
+  if (negated){
+    node->charClass = charClassComplement(node->charClass);
+  }
+  return internRegexNode(node);
 }
 
 /*
  * OWN CODE
- * parse for regex with form <plus>
+ * parse for regex with form <atom>
  */
-Z3_ast parsePlus(Z3_theory t, std::string regexStr, Z3_ast & breakDownAssert){
-  if (regexStr[regexStr.length() - 1] != '+'){
+const T_regexNode * parseRegexAtom(const std::string & regexStr, unsigned int & pos){
+  unsigned int begin = pos;
+  char c = regexStr[pos ++];
+  if (c == '('){
+    const T_regexNode * inner = parseRegexUnion(regexStr, pos);
+    if (inner == NULL || pos >= regexStr.length() || regexStr[pos] != ')'){
+#ifdef DEBUGLOG
+      __debugPrint(logFile, ">> parseRegexAtom(): %s unbalanced ( %d\n", regexStr.c_str(), __LINE__);
+#endif
+      return NULL;
+    }
+    ++ pos;
+    return inner;
+  } else if (c == '['){
+    return parseRegexClass(regexStr, pos);
+  } else if (c == '.'){
+    return internRegexNode(newRegexNode(regex_Any, regexStr, begin, pos));
+  } else if (c == '^' || c == '$'){
+    return internRegexNode(newRegexNode(c == '^' ? regex_Begin : regex_End, regexStr, begin, pos));
+  } else if (c == '\\' && pos < regexStr.length()){
+    char e = regexStr[pos ++];
+    T_charClass escClass;
+    if (getEscapeClass(e, escClass)){
+      T_regexNode * node = newRegexNode(regex_Class, regexStr, begin, pos);
+      node->charClass = escClass;
+      return internRegexNode(node);
+    }
+    T_regexNode * node = newRegexNode(regex_Literal, regexStr, begin, pos);
+    node->literal = std::string(1, getEscapedChar(e));
+    return internRegexNode(node);
+  } else if (c == ')' || c == '|' || c == '*' || c == '+' || c == '?'){
 #ifdef DEBUGLOG
-      __debugPrint(logFile, ">> parsePlus(): %s invalid regex-plus Type %d\n", regexStr.c_str(), __LINE__);
+    __debugPrint(logFile, ">> parseRegexAtom(): %s unexpected %c %d\n", regexStr.c_str(), c, __LINE__);
 #endif
     return NULL;
   }
-  regexStr = regexStr.substr(0, regexStr.length() - 1);
-  
-  Z3_context ctx = Z3_theory_get_context(t);
-  Z3_ast intVar = my_mk_internal_int_var(t);
-  Z3_ast result = mk_star(t, my_mk_regex_value(t, regexStr.c_str()), intVar, breakDownAssert);
-  breakDownAssert = Z3_mk_ge(ctx, intVar, mk_int(ctx, 1));
-  
-  return result;
+  T_regexNode * node = newRegexNode(regex_Literal, regexStr, begin, pos);
+  node->literal = std::string(1, c);
+  return internRegexNode(node);
 }
 
 /*
  * OWN CODE
- * parse for regex with form <counter>
+ * Read "{n}", "{n,}" or "{n,m}" at pos. Return false (pos unchanged) otherwise.
  */
-Z3_ast parseCounter(Z3_theory t, std::string regexStr, Z3_ast & breakDownAssert){
-  if (regexStr[regexStr.length() - 1] != '}'){
-#ifdef DEBUGLOG
-      __debugPrint(logFile, ">> parseCounter(): %s invalid regex-counter Type %d\n", regexStr.c_str(), __LINE__);
-#endif
-    return NULL;
+bool parseRegexCounter(const std::string & regexStr, unsigned int & pos, int & low, int & high){
+  unsigned int p = pos + 1;
+  unsigned int numStart = p;
+  while (p < regexStr.length() && isdigit(regexStr[p])) ++ p;
+  if (p == numStart || p >= regexStr.length()){
+    return false;
   }
-  int id = regexStr.length() - 1;
-  while (id >= 0 && regexStr[id] != '{'){
-    -- id;
+  low = atoi(regexStr.substr(numStart, p - numStart).c_str());
+  high = low;
+  if (regexStr[p] == ','){
+    ++ p;
+    numStart = p;
+    while (p < regexStr.length() && isdigit(regexStr[p])) ++ p;
+    high = (p == numStart) ? -1 : atoi(regexStr.substr(numStart, p - numStart).c_str());
   }
-  if (id < 0){
-#ifdef DEBUGLOG
-      __debugPrint(logFile, ">> parseCounter(): %s invalid regex-counter Type %d\n", regexStr.c_str(), __LINE__);
-#endif
-    return NULL;
+  if (p >= regexStr.length() || regexStr[p] != '}' || (high != -1 && high < low)){
+    return false;
   }
-  std::string counterStr = regexStr.substr(id + 1, regexStr.length() - id - 2);  
-  regexStr = regexStr.substr(0, id);  
-  Z3_context ctx = Z3_theory_get_context(t);
+  pos = p + 1;
+  return true;
+}
+
+/*
+ * OWN CODE
+ * parse for regex with form <star>, <plus>, <question> and <counter>
+ */
+const T_regexNode * parseRegexRepeat(const std::string & regexStr, unsigned int & pos){
+  unsigned int begin = pos;
+  const T_regexNode * node = parseRegexAtom(regexStr, pos);
+  while (node != NULL && pos < regexStr.length()){
+    char c = regexStr[pos];
+    T_regexNode * rep = NULL;
+    if (c == '*' || c == '+' || c == '?'){
+      ++ pos;
+      rep = newRegexNode(c == '*' ? regex_Star : (c == '+' ? regex_Plus : regex_Question), regexStr, begin, pos);
+    } else if (c == '{'){
+      int low = 0;
+      int high = -1;
+      if (! parseRegexCounter(regexStr, pos, low, high)){
+        break;
+      }
+      if (low == high && (node->kind == regex_Literal || node->kind == regex_Empty)
+          && node->literal.length() * low <= maxFoldedCounterLiteral){
+        // "ab{3}" style counters are plain constants
+        rep = newRegexNode(low == 0 ? regex_Empty : regex_Literal, regexStr, begin, pos);
+        for (int i = 0; i < low; ++ i){
+          rep->literal += node->literal;
+        }
+        node = internRegexNode(rep);
+        continue;
+      }
+      rep = newRegexNode(regex_Counter, regexStr, begin, pos);
+      rep->low = low;
+      rep->high = high;
+    } else {
+      break;
+    }
+    rep->children.push_back(node);
+    node = internRegexNode(rep);
+  }
+  return node;
+}
+
+/*
+ * OWN CODE
+ * parse for regex with form <concat>, adjacent literals are merged
+ */
+const T_regexNode * parseRegexConcat(const std::string & regexStr, unsigned int & pos){
+  unsigned int begin = pos;
+  std::vector<const T_regexNode *> items;
+  std::vector<unsigned int> itemStart;
+  while (pos < regexStr.length() && regexStr[pos] != '|' && regexStr[pos] != ')'){
+    unsigned int start = pos;
+    const T_regexNode * item = parseRegexRepeat(regexStr, pos);
+    if (item == NULL){
+      return NULL;
+    }
+    if (item->kind == regex_Literal && items.size() > 0 && items.back()->kind == regex_Literal){
+      T_regexNode * merged = newRegexNode(regex_Literal, regexStr, itemStart.back(), pos);
+      merged->literal = items.back()->literal + item->literal;
+      items.back() = internRegexNode(merged);
+    } else {
+      items.push_back(item);
+      itemStart.push_back(start);
+    }
+  }
+  if (items.size() == 0){
+    return internRegexNode(newRegexNode(regex_Empty, regexStr, begin, pos));
+  } else if (items.size() == 1){
+    return items[0];
+  }
+  T_regexNode * node = newRegexNode(regex_Concat, regexStr, begin, pos);
+  node->children = items;
+  return internRegexNode(node);
+}
+
+/*
+ * OWN CODE
+ * parse for regex with form <union>
+ */
+const T_regexNode * parseRegexUnion(const std::string & regexStr, unsigned int & pos){
+  unsigned int begin = pos;
+  std::vector<const T_regexNode *> items;
+  while (true){
+    const T_regexNode * item = parseRegexConcat(regexStr, pos);
+    if (item == NULL){
+      return NULL;
+    }
+    items.push_back(item);
+    if (pos < regexStr.length() && regexStr[pos] == '|'){
+      ++ pos;
+    } else {
+      break;
+    }
+  }
+  if (items.size() == 1){
+    return items[0];
+  }
+  T_regexNode * node = newRegexNode(regex_Union, regexStr, begin, pos);
+  node->children = items;
+  return internRegexNode(node);
+}
+
+/*
+ * OWN CODE
+ * Rewrite pass run on every parsed pattern before it is used, so that
+ * equivalent spellings share nodes and encode to fewer terms:
+ *   (r*)* (r+)* (r?)* => r*        r{0,} r{1,} r{0,1} => r* r+ r?
+ *   a|a => a          a|b|[c-e] => [a-e]        [a] => a
+ *   foo|foobar => foo(bar)?        x|y| => (x|y)?
+ * Nested concats and unions are flattened and adjacent literals merged.
+ * Rewritten nodes get a canonical text, printed from their structure,
+ * and live in their own intern namespace.
+ */
+std::map<const T_regexNode *, const T_regexNode *> regexSimplifyCache;
+
+std::string regexLiteralText(const std::string & literal){
+  std::string text = "";
+  for (unsigned int i = 0; i < literal.length(); ++ i){
+    if (literal[i] != '\0' && strchr("\\.[]{}()*+?|^$", literal[i]) != NULL){
+      text += '\\';
+    }
+    text += literal[i];
+  }
+  return text;
+}
+
+std::string regexClassText(const T_charClass & cls){
+  if (charClassSize(cls) == 256){
+    return "[\\s\\S]";
+  }
+  // '\0' cannot be written in the pattern, classes holding it are negated
+  bool negated = charClassContains(cls, 0);
+  T_charClass listed = negated ? charClassComplement(cls) : cls;
+  std::string text = negated ? "[^" : "[";
+  for (unsigned int i = 0; i < listed.size(); ++ i){
+    for (int c = listed[i].first; c <= listed[i].second; ++ c){
+      if (c > listed[i].first && c < listed[i].second){
+        text += '-';
+        c = listed[i].second;
+      }
+      if (strchr("\\]^-[", c) != NULL){
+        text += '\\';
+      }
+      text += (char) c;
+    }
+  }
+  return text + "]";
+}
+
+/*
+ * OWN CODE
+ * Intern a rewritten node, its text is printed from its structure
+ */
+const T_regexNode * mkSimpleRegexNode(T_regexNode * node){
+  std::string text = "";
+  switch (node->kind){
+    case regex_Empty:
+      break;
+    case regex_Literal:
+      text = regexLiteralText(node->literal);
+      break;
+    case regex_Any:
+      text = ".";
+      break;
+    case regex_Class:
+      text = regexClassText(node->charClass);
+      break;
+    case regex_Concat:
+      for (unsigned int i = 0; i < node->children.size(); ++ i){
+        bool group = (node->children[i]->kind == regex_Union);
+        text += group ? "(" + node->children[i]->text + ")" : node->children[i]->text;
+      }
+      break;
+    case regex_Union:
+      for (unsigned int i = 0; i < node->children.size(); ++ i){
+        text += (i == 0) ? node->children[i]->text : "|" + node->children[i]->text;
+      }
+      break;
+    default: {
+      const T_regexNode * child = node->children[0];
+      bool atom = child->kind == regex_Any || child->kind == regex_Class
+          || (child->kind == regex_Literal && child->literal.length() == 1);
+      text = atom ? child->text : "(" + child->text + ")";
+      if (node->kind == regex_Star){
+        text += "*";
+      } else if (node->kind == regex_Plus){
+        text += "+";
+      } else if (node->kind == regex_Question){
+        text += "?";
+      } else {
+        std::stringstream ss;
+        ss << "{" << node->low;
+        if (node->high != node->low){
+          ss << ",";
+          if (node->high != -1){
+            ss << node->high;
+          }
+        }
+        ss << "}";
+        text += ss.str();
+      }
+    }
+  }
+  node->text = text;
+  std::stringstream ss;
+  ss << "s" << (int) node->kind << ":" << text;
+  std::string key = ss.str();
+  std::map<std::string, const T_regexNode *>::iterator it = regexNodeTable.find(key);
+  if (it != regexNodeTable.end()){
+    delete node;
+    return it->second;
+  }
+  regexNodeTable[key] = node;
+  return node;
+}
+
+const T_regexNode * mkSimpleLeaf(T_regexKind kind, const std::string & literal, const T_charClass & cls){
+  T_regexNode * node = new T_regexNode();
+  node->kind = kind;
+  node->literal = literal;
+  node->charClass = cls;
+  node->low = 0;
+  node->high = -1;
+  if (kind == regex_Class && charClassSize(cls) == 1){
+    node->kind = regex_Literal;
+    node->literal = std::string(1, (char) cls[0].first);
+    node->charClass.clear();
+  }
+  return mkSimpleRegexNode(node);
+}
 
-  Z3_ast result = NULL;  
-  int temp = (int) counterStr.find_first_of(",");
-  if (temp != (int) std::string::npos){
-    Z3_ast intVar = my_mk_internal_int_var(t);
-  
-    int first = atoi(counterStr.substr(0, temp).c_str());
-    breakDownAssert = Z3_mk_ge(ctx, intVar, mk_int(ctx, first));
-    if (temp + 1 == (int) counterStr.length()){
+const T_regexNode * mkSimpleConcat(const std::vector<const T_regexNode *> & items){
+  std::vector<const T_regexNode *> flat;
+  for (unsigned int i = 0; i < items.size(); ++ i){
+    std::vector<const T_regexNode *> parts;
+    if (items[i]->kind == regex_Concat){
+      parts = items[i]->children;
+    } else if (items[i]->kind != regex_Empty){
+      parts.push_back(items[i]);
+    }
+    for (unsigned int j = 0; j < parts.size(); ++ j){
+      if (parts[j]->kind == regex_Literal && flat.size() > 0 && flat.back()->kind == regex_Literal){
+        flat.back() = mkSimpleLeaf(regex_Literal, flat.back()->literal + parts[j]->literal, T_charClass());
+      } else {
+        flat.push_back(parts[j]);
+      }
+    }
+  }
+  if (flat.size() == 0){
+    return mkSimpleLeaf(regex_Empty, "", T_charClass());
+  } else if (flat.size() == 1){
+    return flat[0];
+  }
+  T_regexNode * node = new T_regexNode();
+  node->kind = regex_Concat;
+  node->low = 0;
+  node->high = -1;
+  node->children = flat;
+  return mkSimpleRegexNode(node);
+}
+
+const T_regexNode * mkSimpleRepeat(T_regexKind kind, const T_regexNode * child, int low, int high);
+
+/*
+ * OWN CODE
+ * Items of a union branch, literals split into single characters so that
+ * common prefixes and suffixes can be compared node by node
+ */
+std::vector<const T_regexNode *> regexBranchItems(const T_regexNode * branch){
+  std::vector<const T_regexNode *> parts;
+  if (branch->kind == regex_Concat){
+    parts = branch->children;
+  } else if (branch->kind != regex_Empty){
+    parts.push_back(branch);
+  }
+  std::vector<const T_regexNode *> items;
+  for (unsigned int i = 0; i < parts.size(); ++ i){
+    if (parts[i]->kind == regex_Literal){
+      for (unsigned int j = 0; j < parts[i]->literal.length(); ++ j){
+        items.push_back(mkSimpleLeaf(regex_Literal, parts[i]->literal.substr(j, 1), T_charClass()));
+      }
     } else {
-      int second = atoi(counterStr.substr(temp + 1, counterStr.length() - temp - 1).c_str());
-      breakDownAssert = mk_2_and(t, breakDownAssert, Z3_mk_le(ctx, intVar, mk_int(ctx, second)));
+      items.push_back(parts[i]);
     }
-    Z3_ast assert = NULL;//don't need to use this one
-    result = mk_star(t, my_mk_regex_value(t, regexStr.c_str()), intVar, assert);    
+  }
+  return items;
+}
+
+const T_regexNode * mkSimpleUnion(const std::vector<const T_regexNode *> & branches){
+  // flatten, drop duplicates and the empty branch, merge single characters
+  std::vector<const T_regexNode *> items;
+  std::set<const T_regexNode *> seen;
+  bool nullable = false;
+  bool hasChars = false;
+  T_charClass chars;
+  std::vector<const T_regexNode *> todo(branches.rbegin(), branches.rend());
+  while (! todo.empty()){
+    const T_regexNode * branch = todo.back();
+    todo.pop_back();
+    if (branch->kind == regex_Union){
+      todo.insert(todo.end(), branch->children.rbegin(), branch->children.rend());
+    } else if (branch->kind == regex_Empty){
+      nullable = true;
+    } else if (branch->kind == regex_Any || branch->kind == regex_Class
+        || (branch->kind == regex_Literal && branch->literal.length() == 1)){
+      T_charClass cls = (branch->kind == regex_Any) ? T_charClass(1, std::make_pair(0, 255)) : branch->charClass;
+      if (branch->kind == regex_Literal){
+        charClassAddRange(cls, (unsigned char) branch->literal[0], (unsigned char) branch->literal[0]);
+      }
+      chars = charClassUnion(chars, cls);
+      if (! hasChars){
+        items.push_back(NULL);  // place of the merged class
+        hasChars = true;
+      }
+    } else if (seen.insert(branch).second){
+      items.push_back(branch);
+    }
+  }
+  for (unsigned int i = 0; i < items.size(); ++ i){
+    if (items[i] == NULL){
+      items[i] = (charClassSize(chars) == 256) ? mkSimpleLeaf(regex_Any, "", T_charClass()) : mkSimpleLeaf(regex_Class, "", chars);
+    }
+  }
+
+  const T_regexNode * result = NULL;
+  if (items.size() == 0){
+    return mkSimpleLeaf(regex_Empty, "", T_charClass());
+  } else if (items.size() == 1){
+    result = items[0];
   } else {
-    int repeatTimes = atoi(counterStr.c_str());
-    std::string new_regex = "";
-    for (int id = 0; id < repeatTimes; ++ id){
-      new_regex += "(" + regexStr + ")";
+    // factor the common prefix and suffix out of the branches
+    std::vector<std::vector<const T_regexNode *> > split;
+    unsigned int minLen = UINT_MAX;
+    for (unsigned int i = 0; i < items.size(); ++ i){
+      split.push_back(regexBranchItems(items[i]));
+      minLen = std::min(minLen, (unsigned int) split.back().size());
+    }
+    unsigned int prefix = 0;
+    while (prefix < minLen){
+      unsigned int i = 1;
+      while (i < split.size() && split[i][prefix] == split[0][prefix]) ++ i;
+      if (i < split.size()) break;
+      ++ prefix;
+    }
+    unsigned int suffix = 0;
+    while (prefix + suffix < minLen){
+      unsigned int i = 1;
+      while (i < split.size() && split[i][split[i].size() - 1 - suffix] == split[0][split[0].size() - 1 - suffix]) ++ i;
+      if (i < split.size()) break;
+      ++ suffix;
+    }
+    if (prefix + suffix > 0){
+      std::vector<const T_regexNode *> middle;
+      for (unsigned int i = 0; i < split.size(); ++ i){
+        middle.push_back(mkSimpleConcat(std::vector<const T_regexNode *>(split[i].begin() + prefix, split[i].end() - suffix)));
+      }
+      std::vector<const T_regexNode *> parts(split[0].begin(), split[0].begin() + prefix);
+      parts.push_back(mkSimpleUnion(middle));
+      parts.insert(parts.end(), split[0].end() - suffix, split[0].end());
+      result = mkSimpleConcat(parts);
+    } else {
+      T_regexNode * node = new T_regexNode();
+      node->kind = regex_Union;
+      node->low = 0;
+      node->high = -1;
+      node->children = items;
+      result = mkSimpleRegexNode(node);
     }
-    result = regex_parse(t, new_regex, breakDownAssert);
   }
-  
-  return result;
+  return nullable ? mkSimpleRepeat(regex_Question, result, 0, 1) : result;
 }
 
 /*
  * OWN CODE
- * parse for regex with form <group>
+ * Star, Plus, Question and Counter all are child{low,high}
  */
-Z3_ast parseGroup(Z3_theory t, std::string regexStr, Z3_ast & assert){
-  if (regexStr[0] != '(' || regexStr[regexStr.length() - 1] != ')'){
-#ifdef DEBUGLOG
-      __debugPrint(logFile, ">> parseGroup(): %s invalid regex-group Type %d\n", regexStr.c_str(), __LINE__);
-#endif
-    return NULL;
+const T_regexNode * mkSimpleRepeat(T_regexKind kind, const T_regexNode * child, int low, int high){
+  if (kind == regex_Star){
+    low = 0;
+    high = -1;
+  } else if (kind == regex_Plus){
+    low = 1;
+    high = -1;
+  } else if (kind == regex_Question){
+    low = 0;
+    high = 1;
+  }
+  if (child->kind == regex_Empty || high == 0){
+    return mkSimpleLeaf(regex_Empty, "", T_charClass());
+  } else if (low == 1 && high == 1){
+    return child;
+  }
+  // (r*)* (r+)? (r?)+ ... all are r*, nesting only matters for counters
+  bool inner = child->kind == regex_Star || child->kind == regex_Plus || child->kind == regex_Question;
+  if (inner && low <= 1 && (high == -1 || high == 1)){
+    bool nullable = (child->kind != regex_Plus || low == 0);
+    bool unbounded = (child->kind != regex_Question || high == -1);
+    kind = nullable ? (unbounded ? regex_Star : regex_Question) : regex_Plus;
+    return mkSimpleRepeat(kind, child->children[0], 0, 0);
+  }
+  if (child->kind == regex_Literal && low == high && child->literal.length() * low <= maxFoldedCounterLiteral){
+    std::string literal = "";
+    for (int i = 0; i < low; ++ i){
+      literal += child->literal;
+    }
+    return mkSimpleLeaf(regex_Literal, literal, T_charClass());
   }
-  regexStr = regexStr.substr(1, regexStr.length() - 2);
-  
-  return regex_parse(t, regexStr, assert);
+  T_regexNode * node = new T_regexNode();
+  node->kind = (high == -1) ? (low == 0 ? regex_Star : (low == 1 ? regex_Plus : regex_Counter))
+      : ((low == 0 && high == 1) ? regex_Question : regex_Counter);
+  node->low = low;
+  node->high = high;
+  node->children.push_back(child);
+  return mkSimpleRegexNode(node);
 }
 
 /*
  * OWN CODE
- * parse special characters
  */
-Z3_ast parseSpecialCharacter(Z3_theory t, std::string regexStr, Z3_ast & assert){
-  if (regexStr[0] != '.' || regexStr.length() != 2 || regexStr[0] != '\\'){
-#ifdef DEBUGLOG
-      __debugPrint(logFile, ">> parseSpecialCharacter(): %s invalid regex-specialChar Type %d\n", regexStr.c_str(), __LINE__);
-#endif    
-    return NULL;
+const T_regexNode * simplifyRegexNode(const T_regexNode * node){
+  std::map<const T_regexNode *, const T_regexNode *>::iterator it = regexSimplifyCache.find(node);
+  if (it != regexSimplifyCache.end()){
+    return it->second;
   }
-  Z3_context ctx = Z3_theory_get_context(t);
-  Z3_ast result = NULL;
-  if (regexStr[0] == '.' && regexStr.length() == 1){
-    result = my_mk_internal_string_var(t);
-    assert = Z3_mk_eq(ctx, mk_length(t, result), mk_int(ctx, 1));
-  } else if (regexStr[1] == 'w'){  //TODO    
-  } else if (regexStr[1] == 'W'){
-  } else if (regexStr[1] == 'd'){
-  } else if (regexStr[1] == 'D'){
-  } else if (regexStr[1] == 's'){
-  } else if (regexStr[1] == 'S'){
-  }
-  
+  std::vector<const T_regexNode *> children;
+  for (unsigned int i = 0; i < node->children.size(); ++ i){
+    children.push_back(simplifyRegexNode(node->children[i]));
+  }
+  const T_regexNode * result = NULL;
+  switch (node->kind){
+    case regex_Begin:
+    case regex_End:
+      result = mkSimpleLeaf(regex_Empty, "", T_charClass());
+      break;
+    case regex_Empty:
+    case regex_Literal:
+    case regex_Any:
+    case regex_Class:
+      result = mkSimpleLeaf(node->kind, node->literal, node->charClass);
+      break;
+    case regex_Concat:
+      result = mkSimpleConcat(children);
+      break;
+    case regex_Union:
+      result = mkSimpleUnion(children);
+      break;
+    default:
+      result = mkSimpleRepeat(node->kind, children[0], node->low, node->high);
+  }
+  regexSimplifyCache[node] = result;
   return result;
 }
 
 /*
  * OWN CODE
- * parse for regex with form <union>
+ * Every anchor of node can only be met at the start ('^') or at the end ('$')
+ * of the matched string. atStart / atEnd: nothing but anchors may come before
+ * / after node. Anchors under a repeat are rejected.
  */
-/*Z3_ast parseUnion(Z3_theory t, std::string regexStr, Z3_ast & assert){
-  int unionCharId = (int) regexStr.find("|");
-  if (unionCharId == (int) std::string::npos){
+bool regexAnchorsValid(const T_regexNode * node, bool atStart, bool atEnd){
+  switch (node->kind){
+    case regex_Begin:
+      return atStart;
+    case regex_End:
+      return atEnd;
+    case regex_Concat:
+      for (unsigned int i = 0; i < node->children.size(); ++ i){
+        bool start = atStart;
+        for (unsigned int j = 0; j < i && start; ++ j){
+          start = (node->children[j]->kind == regex_Begin);
+        }
+        bool end = atEnd;
+        for (unsigned int j = i + 1; j < node->children.size() && end; ++ j){
+          end = (node->children[j]->kind == regex_End);
+        }
+        if (! regexAnchorsValid(node->children[i], start, end)){
+          return false;
+        }
+      }
+      return true;
+    case regex_Union:
+      for (unsigned int i = 0; i < node->children.size(); ++ i){
+        if (! regexAnchorsValid(node->children[i], atStart, atEnd)){
+          return false;
+        }
+      }
+      return true;
+    default:
+      for (unsigned int i = 0; i < node->children.size(); ++ i){
+        if (! regexAnchorsValid(node->children[i], false, false)){
+          return false;
+        }
+      }
+      return true;
+  }
+}
+
+/*
+ * OWN CODE
+ * Parsed and simplified tree of regexStr, NULL if regexStr is malformed or
+ * has an anchor that is not at its start / end
+ */
+const T_regexNode * getRegexAst(const std::string & regexStr){
+  std::map<std::string, const T_regexNode *>::iterator it = regexAstCache.find(regexStr);
+  if (it != regexAstCache.end()){
+    return it->second;
+  }
+  unsigned int pos = 0;
+  const T_regexNode * root = parseRegexUnion(regexStr, pos);
+  if (root != NULL && pos != regexStr.length()){
+#ifdef DEBUGLOG
+    __debugPrint(logFile, ">> getRegexAst(): %s unexpected %c at %d %d\n", regexStr.c_str(), regexStr[pos], pos, __LINE__);
+#endif
+    root = NULL;
+  }
+  if (root != NULL && ! regexAnchorsValid(root, true, true)){
 #ifdef DEBUGLOG
-      __debugPrint(logFile, ">> parseUnion(): %s invalid regex-union Type %d\n", regexStr.c_str(), __LINE__);
+    __debugPrint(logFile, ">> getRegexAst(): %s has an anchor inside %d\n", regexStr.c_str(), __LINE__);
 #endif
+    root = NULL;
+  }
+  if (root != NULL){
+    root = simplifyRegexNode(root);
+  }
+  regexAstCache[regexStr] = root;
+  return root;
+}
+
+/*
+ * OWN CODE
+ */
+Z3_ast mkRegexAssert(Z3_theory t, std::vector<Z3_ast> & asserts){
+  if (asserts.size() == 0){
     return NULL;
+  } else if (asserts.size() == 1){
+    return asserts[0];
   }
-  std::string first = regexStr.substr(0, unionCharId);
-  std::string second = regexStr.substr(unionCharId + 1, regexStr.length() - unionCharId - 1);
-  Z3_context ctx = Z3_theory_get_context(t);  
-  
-  Z3_ast result = my_mk_internal_string_var(t);
-  Z3_ast assert1 = Z3_mk_eq(ctx, result, my_mk_str_value(t, first.c_str()));
-  Z3_ast assert2 = Z3_mk_eq(ctx, result, my_mk_str_value(t, second.c_str()));
-  assert = mk_2_or(t, assert1, assert2);
-  
-  return result;
-} */
- 
+  return Z3_mk_and(Z3_theory_get_context(t), asserts.size(), &asserts[0]);
+}
+
+Z3_ast regexToZ3(Z3_theory t, const T_regexNode * node, std::vector<Z3_ast> & asserts);
+
 /*
  * OWN CODE
+ * Z3 term for one occurrence of node, side constraints go to asserts
  */
-Z3_ast regex_parse(Z3_theory t, std::string regexStr, Z3_ast & breakDownAssert){
-  breakDownAssert = NULL;
+Z3_ast regexToZ3(Z3_theory t, const T_regexNode * node, std::vector<Z3_ast> & asserts){
   Z3_context ctx = Z3_theory_get_context(t);
-  if (regexStr.size() == 0){
-    return my_mk_str_value(t, "");
-  }
-  std::stack<std::string> components;
-  for (int id = 0; id < (int) regexStr.length(); ++ id){
-    //TODO 
-    if (regexStr[id] == '*' || regexStr[id] == '?' || regexStr[id] == '+'){
-      if (components.size() <= 0){
-#ifdef DEBUGLOG
-      __debugPrint(logFile, ">> regex_parse(): %s invalid Type %d\n", regexStr.c_str(), __LINE__);
-#endif      
-        return NULL;
-      } else {
-        std::string temp = components.top() + regexStr.substr(id, 1); 
-        components.pop();
-/*#ifdef DEBUGLOG
-      __debugPrint(logFile, ">> regex_parse(): push %s %d\n", temp.c_str(), __LINE__);
-#endif    */      
-        components.push(temp);
+  switch (node->kind){
+    case regex_Empty:
+    case regex_Begin:
+    case regex_End:
+      // anchors are removed by simplifyRegexNode, they match the empty string
+      return my_mk_str_value(t, "");
+    case regex_Literal:
+      return my_mk_str_value(t, node->literal.c_str());
+    case regex_Any: {
+      Z3_ast character = my_mk_internal_string_var(t);
+      asserts.push_back(Z3_mk_eq(ctx, mk_length(t, character), mk_int(ctx, 1)));
+      return character;
+    }
+    case regex_Class: {
+      // list whichever of the class and its complement is smaller
+      int size = charClassSize(node->charClass);
+      bool negated = (size > 128);
+      if (size != 256 && (negated ? 256 - size : size) > maxClassDisjuncts){
+        // a wide class is one Matches atom instead of one equality per character
+        return mkRegexAtomVar(t, node->text, asserts);
       }
-    } else if (regexStr[id] == ']' || regexStr[id] == '}' || regexStr[id] == ')'){
-      char tempChar;
-      if (regexStr[id] == ']') { tempChar = '['; }
-      else if (regexStr[id] == '}') { tempChar = '{'; }
-      else { tempChar = '('; }
-      
-      std::string in;
-      std::string tempStr = regexStr.substr(id, 1);
-      do {
-        if (components.size() <= 0){
-#ifdef DEBUGLOG
-      __debugPrint(logFile, ">> regex_parse(): %s invalid Type %d\n", regexStr.c_str(), __LINE__);
-#endif      
-        return NULL;
-        }
-        in = components.top();
-        tempStr = in + tempStr;
-        components.pop();
-      } while (in[0] != tempChar || in.size() != 1);
-      if (tempChar == '{'){
-        tempStr = components.top() + tempStr;
-        components.pop();
+      Z3_ast character = my_mk_internal_string_var(t);
+      asserts.push_back(Z3_mk_eq(ctx, mk_int(ctx, 1), mk_length(t, character)));
+      if (size == 256){
+        return character;
       }
-/*#ifdef DEBUGLOG
-      __debugPrint(logFile, ">> regex_parse(): push %s %d\n", tempStr.c_str(), __LINE__);
-#endif          */
-      components.push(tempStr);
-    } else {
-/*#ifdef DEBUGLOG
-      __debugPrint(logFile, ">> regex_parse(): push %s %d\n", regexStr.substr(id, 1).c_str(), __LINE__);
-#endif  */
-      components.push(regexStr.substr(id, 1));
-    }
-  }
-  Z3_ast currentAst = NULL;
-  std::set<Z3_ast> or_list;
-  std::set<Z3_ast> assert_list;
-  while (! components.empty()){
-    std::string tempStr = components.top();
-    components.pop();
-    if (tempStr.size() == 1 && tempStr[0] == '|'){
-      or_list.insert(currentAst);
-      currentAst = NULL;
-    } else {
-      Z3_ast strAst = NULL;
-      if (isSimpleRegex(tempStr)){
-        while (! components.empty() && isSimpleRegex(components.top())){
-          tempStr = components.top() + tempStr;
-          components.pop();
-        }
-        strAst = my_mk_str_value(t, tempStr.c_str());
-      } else {
-        char lastTempStr = tempStr[tempStr.length() - 1];
-        Z3_ast assert = NULL;
-        if (lastTempStr == '*'){
-          strAst = parseStar(t, tempStr, assert);
-        } else if (lastTempStr == '+'){
-          strAst = parsePlus(t, tempStr, assert);
-        } else if (lastTempStr == '?'){
-          strAst = parseQuestion(t, tempStr, assert);
-        } else if (lastTempStr == ']'){
-          strAst = parseBraces(t, tempStr, assert);
-        } else if (lastTempStr == '}'){
-          strAst = parseCounter(t, tempStr, assert);
-        } else if (lastTempStr == ')'){
-          strAst = parseGroup(t, tempStr, assert);
-        } else {
-#ifdef DEBUGLOG
-      __debugPrint(logFile, ">> regex_parse(): unknown components %s %d\n\n", tempStr.c_str(), __LINE__);
-#endif        
-        }
-        if (assert != NULL){
-          assert_list.insert(assert);
+      T_charClass listed = negated ? charClassComplement(node->charClass) : node->charClass;
+      std::vector<Z3_ast> or_items;
+      for (unsigned int i = 0; i < listed.size(); ++ i){
+        for (int c = listed[i].first; c <= listed[i].second; ++ c){
+          if (c == 0){
+            continue;  // no string constant holds '\0'
+          }
+          std::string charStr(1, (char) c);
+          or_items.push_back(Z3_mk_eq(ctx, character, my_mk_str_value(t, charStr.c_str())));
         }
       }
-      if (currentAst == NULL){
-        currentAst = strAst;
-      } else {
-        if (currentAst == NULL){
-          // must meet unknown components
-        } else {
-          currentAst = mk_concat(t, strAst, currentAst);
+      Z3_ast in = or_items.size() == 0 ? Z3_mk_false(ctx) : Z3_mk_or(ctx, or_items.size(), &or_items[0]);
+      asserts.push_back(negated ? Z3_mk_not(ctx, in) : in);
+      return character;
+    }
+    case regex_Concat: {
+      Z3_ast result = NULL;
+      for (int i = (int) node->children.size() - 1; i >= 0; -- i){
+        Z3_ast item = regexToZ3(t, node->children[i], asserts);
+        result = (result == NULL) ? item : mk_concat(t, item, result);
+      }
+      return result;
+    }
+    case regex_Union: {
+      Z3_ast result = my_mk_internal_string_var(t);
+      std::vector<Z3_ast> ors;
+      for (unsigned int i = 0; i < node->children.size(); ++ i){
+        // constraints of a branch only hold if the branch is taken
+        std::vector<Z3_ast> branchAsserts;
+        Z3_ast item = regexToZ3(t, node->children[i], branchAsserts);
+        branchAsserts.push_back(Z3_mk_eq(ctx, result, item));
+        ors.push_back(mkRegexAssert(t, branchAsserts));
+      }
+      asserts.push_back(Z3_mk_or(ctx, ors.size(), &ors[0]));
+      return result;
+    }
+    case regex_Star:
+    case regex_Plus: {
+      Z3_ast intVar = my_mk_internal_int_var(t);
+      Z3_ast unused = NULL;
+      Z3_ast result = mk_star(t, my_mk_regex_value(t, node->children[0]->text.c_str()), intVar, unused);
+      asserts.push_back(Z3_mk_ge(ctx, intVar, mk_int(ctx, node->kind == regex_Star ? 0 : 1)));
+      return result;
+    }
+    case regex_Question: {
+      Z3_ast result = my_mk_internal_string_var(t);
+      std::vector<Z3_ast> existAsserts;
+      Z3_ast exist = regexToZ3(t, node->children[0], existAsserts);
+      existAsserts.push_back(Z3_mk_eq(ctx, result, exist));
+      asserts.push_back(mk_2_or(t, mkRegexAssert(t, existAsserts), Z3_mk_eq(ctx, result, my_mk_str_value(t, ""))));
+      return result;
+    }
+    case regex_Counter: {
+      if (node->children[0]->kind != regex_Literal){
+        // one string for all repetitions, decided by the automaton
+        return mkRegexAtomVar(t, node->text, asserts);
+      }
+      // over a literal: the low copies are a constant, the optional part a symbolic Star
+      std::string prefix = "";
+      for (int i = 0; i < node->low; ++ i){
+        prefix += node->children[0]->literal;
+      }
+      Z3_ast result = my_mk_str_value(t, prefix.c_str());
+      if (node->high != node->low){
+        Z3_ast intVar = my_mk_internal_int_var(t);
+        Z3_ast unused = NULL;
+        Z3_ast rest = mk_star(t, my_mk_regex_value(t, node->children[0]->text.c_str()), intVar, unused);
+        asserts.push_back(Z3_mk_ge(ctx, intVar, mk_int(ctx, 0)));
+        if (node->high != -1){
+          asserts.push_back(Z3_mk_le(ctx, intVar, mk_int(ctx, node->high - node->low)));
         }
+        result = (node->low == 0) ? rest : mk_concat(t, result, rest);
       }
+      return result;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * OWN CODE
+ */
+Z3_ast regex_parse(Z3_theory t, std::string regexStr, Z3_ast & breakDownAssert){
+  breakDownAssert = NULL;
+  const T_regexNode * root = getRegexAst(regexStr);
+  if (root == NULL){
 #ifdef DEBUGLOG
-    __debugPrint(logFile, ">> regex_parse(): currentAst = %d ", __LINE__);
-    printZ3Node(t, currentAst);
-    __debugPrint(logFile, "\n\n");
-#endif            
-    }      
-  }
-
-  or_list.insert(currentAst);
-  if (assert_list.size() > 0){
-    Z3_ast * assert = new Z3_ast[assert_list.size()];
-    std::set<Z3_ast>::iterator it; int pos;
-    for (it = assert_list.begin(), pos = 0; it != assert_list.end(); ++ it, ++ pos){
-      assert[pos] = *it;
-    }
-    breakDownAssert = Z3_mk_and(ctx, assert_list.size(), assert);
-    delete[] assert;
-  }
-
-  Z3_ast result = NULL;
-  if (or_list.size() > 1){
-    result = my_mk_internal_string_var(t);
-    Z3_ast * ors = new Z3_ast[or_list.size()];
-    std::set<Z3_ast>::iterator it; int pos;
-    for (it = or_list.begin(), pos = 0; it != or_list.end(); ++ it, ++ pos){
-      ors[pos] = Z3_mk_eq(ctx, result, *it);
-    }
-    breakDownAssert = mk_2_and(t, breakDownAssert, Z3_mk_or(ctx, or_list.size(), ors));
-    delete[] ors;
-  } else {
-    result = currentAst;
+    __debugPrint(logFile, ">> regex_parse(): %s invalid Type %d\n", regexStr.c_str(), __LINE__);
+#endif
+    return NULL;
   }
+  std::vector<Z3_ast> asserts;
+  Z3_ast result = regexToZ3(t, root, asserts);
+  breakDownAssert = mkRegexAssert(t, asserts);
 #ifdef DEBUGLOG
       __debugPrint(logFile, ">> regex_parse(): %d\n", __LINE__);
       printZ3Node(t, result);
       __debugPrint(logFile, "\n and assert: ");
       printZ3Node(t, breakDownAssert);
       __debugPrint(logFile, "\n\n");
-#endif          
+#endif
   return result;
 }
 
-bool isSimpleRegex(std::string regexStr){//TODO
-  if (regexStr.find_first_of("*+?[](){}|") == std::string::npos){
-    return true;
-  } else {
-    return false;
-  }
+bool isSimpleRegex(std::string regexStr){
+  const T_regexNode * root = getRegexAst(regexStr);
+  return root != NULL && (root->kind == regex_Literal || root->kind == regex_Empty);
 }
-
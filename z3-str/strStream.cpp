@@ -0,0 +1,520 @@
+#include "strTheory.h"
+#include "z3str.h"
+
+/*
+ * Streaming SMT-LIB front end (str --stream).
+ *
+ * Commands are read one s-expression at a time and executed right away,
+ * so the input can be a pipe. String constants "..." and regexes '...'
+ * are decoded here (same escapes as Z3-str.py) and built directly through
+ * the z3str API, without the hex encoding step.
+ *
+ * Declarations and assertions after a check-sat go into the live solver.
+ * The theory keeps state in globals that is not scoped by Z3_push/Z3_pop,
+ * so a pop that drops declarations or assertions (and a reset) rebuilds
+ * the solver from the ones still in scope before the next use. That replay
+ * costs as much as the scope it keeps: a stream that pops assertions
+ * after every check-sat pays for its whole remaining prefix each time.
+ */
+
+typedef enum
+{
+  sexpr_List,
+  sexpr_Symbol,
+  sexpr_String,
+  sexpr_Regex
+} T_sexprKind;
+
+struct T_sexpr
+{
+    T_sexprKind kind;
+    std::string atom;
+    std::vector<T_sexpr> items;
+    int line;
+};
+
+struct T_streamState
+{
+    Z3str_solver solver;
+    bool needRebuild;
+    bool hasModel;
+    std::vector<std::pair<std::string, std::string> > decls;
+    std::vector<T_sexpr> asserts;
+    std::vector<std::pair<unsigned int, unsigned int> > scopes;
+    std::map<std::string, std::pair<Z3_ast, std::string> > symbols;
+};
+
+//--------------------------------------------------
+// Reader
+//--------------------------------------------------
+
+/*
+ * Skip blanks and ";" comments, return the next char without consuming it
+ */
+int peekNonBlank(FILE * in, int & line) {
+  int c = fgetc(in);
+  while (c != EOF) {
+    if (c == ';') {
+      while (c != EOF && c != '\n')
+        c = fgetc(in);
+      continue;
+    }
+    if (!isspace(c))
+      break;
+    if (c == '\n')
+      line++;
+    c = fgetc(in);
+  }
+  if (c != EOF)
+    ungetc(c, in);
+  return c;
+}
+
+/*
+ * Read a quoted literal. A backslash protects the quote and itself,
+ * the escapes are decoded later by unescapeLiteral.
+ */
+bool readQuoted(FILE * in, int quote, std::string & out, int & line) {
+  out = "";
+  fgetc(in);
+  int c = fgetc(in);
+  while (c != EOF) {
+    if (c == '\\') {
+      int c2 = fgetc(in);
+      if (c2 == EOF)
+        return false;
+      out.push_back('\\');
+      out.push_back((char) c2);
+      if (c2 == '\n')
+        line++;
+    } else if (c == quote) {
+      return true;
+    } else {
+      if (c == '\n')
+        line++;
+      out.push_back((char) c);
+    }
+    c = fgetc(in);
+  }
+  return false;
+}
+
+/*
+ * Return 1 on success, 0 at end of input, -1 on a syntax error
+ */
+int readSexpr(FILE * in, T_sexpr & e, int & line) {
+  int c = peekNonBlank(in, line);
+  if (c == EOF)
+    return 0;
+  e.line = line;
+  e.items.clear();
+  e.atom = "";
+
+  if (c == '(') {
+    fgetc(in);
+    e.kind = sexpr_List;
+    while (true) {
+      c = peekNonBlank(in, line);
+      if (c == EOF)
+        return -1;
+      if (c == ')') {
+        fgetc(in);
+        return 1;
+      }
+      T_sexpr item;
+      int r = readSexpr(in, item, line);
+      if (r != 1)
+        return -1;
+      e.items.push_back(item);
+    }
+  } else if (c == ')') {
+    fgetc(in);
+    return -1;
+  } else if (c == '"' || c == '\'') {
+    e.kind = (c == '"') ? sexpr_String : sexpr_Regex;
+    return readQuoted(in, c, e.atom, line) ? 1 : -1;
+  } else {
+    e.kind = sexpr_Symbol;
+    while (c != EOF && !isspace(c) && c != '(' && c != ')' && c != '"' && c != '\'' && c != ';') {
+      e.atom.push_back((char) fgetc(in));
+      c = fgetc(in);
+      if (c != EOF)
+        ungetc(c, in);
+    }
+    return 1;
+  }
+}
+
+/*
+ * Python "string_escape" decoding, as done by Z3-str.py
+ */
+std::string unescapeLiteral(const std::string & s) {
+  std::string out;
+  for (unsigned int i = 0; i < s.length(); i++) {
+    if (s[i] != '\\' || i + 1 >= s.length()) {
+      out.push_back(s[i]);
+      continue;
+    }
+    char c = s[++i];
+    switch (c) {
+      case 'n': out.push_back('\n'); break;
+      case 't': out.push_back('\t'); break;
+      case 'r': out.push_back('\r'); break;
+      case 'a': out.push_back('\a'); break;
+      case 'b': out.push_back('\b'); break;
+      case 'f': out.push_back('\f'); break;
+      case 'v': out.push_back('\v'); break;
+      case '\\': out.push_back('\\'); break;
+      case '"': out.push_back('"'); break;
+      case '\'': out.push_back('\''); break;
+      case '\n': break;
+      case 'x': {
+        if (i + 2 < s.length() &&isxdigit(s[i + 1]) && isxdigit(s[i + 2])) {
+          out.push_back((char) strtol(s.substr(i + 1, 2).c_str(), NULL, 16));
+          i += 2;
+        } else {
+          out.push_back('\\');
+          out.push_back('x');
+        }
+        break;
+      }
+      default: {
+        if ('0' <= c && c <= '7') {
+          int v = c - '0';
+          int k = 0;
+          while (k < 2 && i + 1 < s.length() && '0' <= s[i + 1] && s[i + 1] <= '7') {
+            v = v * 8 + (s[++i] - '0');
+            k++;
+          }
+          out.push_back((char) v);
+        } else {
+          out.push_back('\\');
+          out.push_back(c);
+        }
+      }
+    }
+  }
+  return out;
+}
+
+//--------------------------------------------------
+// Terms
+//--------------------------------------------------
+
+void streamError(int line, std::string msg) {
+  printf("(error \"line %d: %s\")\n", line, msg.c_str());
+  fflush(stdout);
+}
+
+/*
+ * Build the Z3 term for e. Return NULL (after reporting) on error.
+ */
+Z3_ast streamMkTerm(T_streamState & st, const T_sexpr & e) {
+  Z3str_solver s = st.solver;
+  Z3_context ctx = z3str_get_context(s);
+
+  if (e.kind == sexpr_String) {
+    std::string str = unescapeLiteral(e.atom);
+    Z3_ast r = z3str_mk_str_const(s, str.data(), str.length());
+    if (r == NULL)
+      streamError(e.line, "string constant contains \\\\x00");
+    return r;
+  }
+  if (e.kind == sexpr_Regex) {
+    std::string regex = unescapeLiteral(e.atom);
+    Z3_ast r = z3str_mk_regex(s, regex.data(), regex.length());
+    if (r == NULL)
+      streamError(e.line, "regex contains \\\\x00");
+    return r;
+  }
+  if (e.kind == sexpr_Symbol) {
+    if (e.atom == "true")
+      return Z3_mk_true(ctx);
+    if (e.atom == "false")
+      return Z3_mk_false(ctx);
+    if (e.atom.find_first_not_of("0123456789") == std::string::npos)
+      return Z3_mk_numeral(ctx, e.atom.c_str(), Z3_mk_int_sort(ctx));
+    std::map<std::string, std::pair<Z3_ast, std::string> >::iterator it = st.symbols.find(e.atom);
+    if (it == st.symbols.end()) {
+      streamError(e.line, "unknown constant " + e.atom);
+      return NULL;
+    }
+    return it->second.first;
+  }
+
+  if (e.items.size() == 0 || e.items[0].kind != sexpr_Symbol) {
+    streamError(e.line, "invalid term");
+    return NULL;
+  }
+  std::string op = e.items[0].atom;
+  unsigned int n = e.items.size() - 1;
+  std::vector<Z3_ast> args;
+  for (unsigned int i = 1; i < e.items.size(); i++) {
+    Z3_ast a = streamMkTerm(st, e.items[i]);
+    if (a == NULL)
+      return NULL;
+    args.push_back(a);
+  }
+
+  if (op == "not" && n == 1)
+    return Z3_mk_not(ctx, args[0]);
+  if (op == "and" && n >= 1)
+    return Z3_mk_and(ctx, n, &args[0]);
+  if (op == "or" && n >= 1)
+    return Z3_mk_or(ctx, n, &args[0]);
+  if (op == "xor" && n == 2)
+    return Z3_mk_xor(ctx, args[0], args[1]);
+  if ((op == "=>" || op == "implies") && n == 2)
+    return Z3_mk_implies(ctx, args[0], args[1]);
+  if (op == "ite" && n == 3)
+    return Z3_mk_ite(ctx, args[0], args[1], args[2]);
+  if (op == "=" && n >= 2) {
+    if (n == 2)
+      return Z3_mk_eq(ctx, args[0], args[1]);
+    std::vector<Z3_ast> eqs;
+    for (unsigned int i = 0; i + 1 < n; i++)
+      eqs.push_back(Z3_mk_eq(ctx, args[i], args[i + 1]));
+    return Z3_mk_and(ctx, eqs.size(), &eqs[0]);
+  }
+  if (op == "distinct" && n >= 2)
+    return Z3_mk_distinct(ctx, n, &args[0]);
+  if (op == "+" && n >= 1)
+    return Z3_mk_add(ctx, n, &args[0]);
+  if (op == "-" && n == 1)
+    return Z3_mk_unary_minus(ctx, args[0]);
+  if (op == "-" && n >= 2)
+    return Z3_mk_sub(ctx, n, &args[0]);
+  if (op == "*" && n >= 1)
+    return Z3_mk_mul(ctx, n, &args[0]);
+  if (op == "<" && n == 2)
+    return Z3_mk_lt(ctx, args[0], args[1]);
+  if (op == "<=" && n == 2)
+    return Z3_mk_le(ctx, args[0], args[1]);
+  if (op == ">" && n == 2)
+    return Z3_mk_gt(ctx, args[0], args[1]);
+  if (op == ">=" && n == 2)
+    return Z3_mk_ge(ctx, args[0], args[1]);
+
+  if (op == "Concat" && n == 2)
+    return z3str_mk_concat(s, args[0], args[1]);
+  if (op == "Length" && n == 1)
+    return z3str_mk_length(s, args[0]);
+  if (op == "Substring" && n == 3)
+    return z3str_mk_substring(s, args[0], args[1], args[2]);
+  if (op == "Indexof" && n == 2)
+    return z3str_mk_indexof(s, args[0], args[1]);
+  if (op == "Contains" && n == 2)
+    return z3str_mk_contains(s, args[0], args[1]);
+  if (op == "StartsWith" && n == 2)
+    return z3str_mk_startswith(s, args[0], args[1]);
+  if (op == "EndsWith" && n == 2)
+    return z3str_mk_endswith(s, args[0], args[1]);
+  if (op == "Replace" && n == 3)
+    return z3str_mk_replace(s, args[0], args[1], args[2]);
+  if (op == "ReplaceAll" && n == 3)
+    return z3str_mk_replaceall(s, args[0], args[1], args[2]);
+  if (op == "Matches" && n == 2)
+    return z3str_mk_matches(s, args[0], args[1]);
+  if (op == "Star" && n == 2)
+    return z3str_mk_star(s, args[0], args[1]);
+
+  streamError(e.line, "unsupported application of " + op);
+  return NULL;
+}
+
+//--------------------------------------------------
+// Commands
+//--------------------------------------------------
+
+/*
+ * Declare name in the live solver
+ */
+bool streamDeclare(T_streamState & st, const std::string & name, const std::string & sort) {
+  Z3_ast v = NULL;
+  if (sort == "String")
+    v = z3str_mk_str_var(st.solver, name.c_str());
+  else if (sort == "Int")
+    v = z3str_mk_int_var(st.solver, name.c_str());
+  else if (sort == "Bool")
+    v = z3str_mk_bool_var(st.solver, name.c_str());
+  else
+    return false;
+  st.symbols[name] = std::make_pair(v, sort);
+  return true;
+}
+
+/*
+ * Start a new solver and replay declarations and assertions
+ */
+void streamRebuild(T_streamState & st) {
+  if (st.solver != NULL)
+    z3str_del_solver(st.solver);
+  st.solver = z3str_mk_solver();
+  st.symbols.clear();
+  st.needRebuild = false;
+  st.hasModel = false;
+  for (unsigned int i = 0; i < st.decls.size(); i++)
+    streamDeclare(st, st.decls[i].first, st.decls[i].second);
+  for (unsigned int i = 0; i < st.asserts.size(); i++) {
+    Z3_ast a = streamMkTerm(st, st.asserts[i]);
+    if (a != NULL)
+      z3str_assert(st.solver, a);
+  }
+}
+
+/*
+ *
+ */
+void streamPrintModel(T_streamState & st) {
+  printf("(model\n");
+  for (unsigned int i = 0; i < st.decls.size(); i++) {
+    std::string name = st.decls[i].first;
+    std::string sort = st.decls[i].second;
+    Z3_ast v = st.symbols[name].first;
+    if (sort == "String") {
+      const char * bytes = NULL;
+      unsigned len = 0;
+      if (!z3str_get_str_value(st.solver, v, &bytes, &len))
+        continue;
+      std::string escaped = "";
+      for (unsigned int k = 0; k < len; k++)
+        escaped = escaped + escapeDict[(unsigned char) bytes[k]];
+      printf("  %s : string -> \"%s\"\n", name.c_str(), escaped.c_str());
+    } else if (sort == "Int") {
+      int value = 0;
+      if (z3str_get_int_value(st.solver, v, &value))
+        printf("  %s : int -> %d\n", name.c_str(), value);
+    } else if (sort == "Bool") {
+      int value = 0;
+      if (z3str_get_bool_value(st.solver, v, &value))
+        printf("  %s : bool -> %s\n", name.c_str(), value ? "true" : "false");
+    }
+  }
+  printf(")\n");
+}
+
+/*
+ * Return false on (exit)
+ */
+bool streamExecute(T_streamState & st, const T_sexpr & cmd) {
+  if (cmd.kind != sexpr_List || cmd.items.size() == 0 || cmd.items[0].kind != sexpr_Symbol) {
+    streamError(cmd.line, "invalid command");
+    return true;
+  }
+  std::string name = cmd.items[0].atom;
+
+  if (name == "declare-variable" || name == "declare-const" || name == "declare-fun") {
+    // (declare-variable x String), (declare-fun x () String)
+    unsigned int sortPos = (name == "declare-fun") ? 3 : 2;
+    if (cmd.items.size() != sortPos + 1 || cmd.items[1].kind != sexpr_Symbol || cmd.items[sortPos].kind != sexpr_Symbol
+        || (name == "declare-fun" && cmd.items[2].items.size() != 0)) {
+      streamError(cmd.line, "unsupported declaration");
+      return true;
+    }
+    std::string var = cmd.items[1].atom;
+    std::string sort = cmd.items[sortPos].atom;
+    if (sort != "String" && sort != "Int" && sort != "Bool") {
+      streamError(cmd.line, "unsupported sort " + sort);
+      return true;
+    }
+    if (st.needRebuild)
+      streamRebuild(st);
+    st.decls.push_back(std::make_pair(var, sort));
+    streamDeclare(st, var, sort);
+  } else if (name == "assert") {
+    if (cmd.items.size() != 2) {
+      streamError(cmd.line, "assert takes one argument");
+      return true;
+    }
+    if (st.needRebuild)
+      streamRebuild(st);
+    Z3_ast a = streamMkTerm(st, cmd.items[1]);
+    if (a == NULL)
+      return true;
+    st.asserts.push_back(cmd.items[1]);
+    z3str_assert(st.solver, a);
+  } else if (name == "check-sat") {
+    if (st.needRebuild)
+      streamRebuild(st);
+    Z3str_result r = z3str_check(st.solver, 0);
+    st.hasModel = (r == Z3STR_SAT);
+    printf("%s\n", r == Z3STR_SAT ? "sat" : (r == Z3STR_UNSAT ? "unsat" : "unknown"));
+  } else if (name == "get-model") {
+    if (!st.hasModel)
+      streamError(cmd.line, "model is not available");
+    else
+      streamPrintModel(st);
+  } else if (name == "push" || name == "pop") {
+    unsigned int k = 1;
+    if (cmd.items.size() == 2 && cmd.items[1].kind == sexpr_Symbol)
+      k = atoi(cmd.items[1].atom.c_str());
+    if (name == "push") {
+      for (unsigned int i = 0; i < k; i++)
+        st.scopes.push_back(std::make_pair(st.decls.size(), st.asserts.size()));
+    } else {
+      if (k > st.scopes.size()) {
+        streamError(cmd.line, "pop without matching push");
+        return true;
+      }
+      std::pair<unsigned int, unsigned int> mark = st.scopes[st.scopes.size() - k];
+      st.scopes.resize(st.scopes.size() - k);
+      if (mark.first < st.decls.size() || mark.second < st.asserts.size()) {
+        st.decls.resize(mark.first);
+        st.asserts.resize(mark.second);
+        st.needRebuild = true;
+      }
+      st.hasModel = false;
+    }
+  } else if (name == "reset") {
+    st.decls.clear();
+    st.asserts.clear();
+    st.scopes.clear();
+    st.needRebuild = true;
+    st.hasModel = false;
+  } else if (name == "exit") {
+    return false;
+  } else if (name == "set-option" || name == "set-info" || name == "set-logic") {
+    // ignored, as in Z3-str.py
+  } else {
+    streamError(cmd.line, "unsupported command " + name);
+  }
+  fflush(stdout);
+  return true;
+}
+
+/*
+ * Read commands from fileName ("" for stdin) and execute them one by one
+ */
+int smtStreamMain(std::string fileName) {
+  FILE * in = stdin;
+  if (fileName != "") {
+    in = fopen(fileName.c_str(), "r");
+    if (in == NULL) {
+      printf("> Error: cannot open %s\n", fileName.c_str());
+      return 1;
+    }
+  }
+
+  T_streamState st;
+  st.solver = NULL;
+  streamRebuild(st);
+
+  int line = 1;
+  while (true) {
+    T_sexpr cmd;
+    int r = readSexpr(in, cmd, line);
+    if (r == 0)
+      break;
+    if (r < 0) {
+      streamError(line, "syntax error");
+      break;
+    }
+    if (!streamExecute(st, cmd))
+      break;
+  }
+
+  z3str_del_solver(st.solver);
+  if (in != stdin)
+    fclose(in);
+  return 0;
+}
@@ -1,6 +1,7 @@
 #include "strTheory.h"
 
 FILE * logFile = NULL;
+std::string inputFile;
 int sLevel = 0;
 int searchStart = 0;
 int tmpStringVarCount = 0;
@@ -24,8 +25,41 @@ std::map<Z3_ast, Z3_ast> simple_regex_map; //OWN CODE: ast2 != NULL => simple; a
 std::map<std::pair<Z3_ast, Z3_ast>, Z3_ast> concat_astNode_map;
 std::map<std::pair<Z3_ast, Z3_ast>, Z3_ast> contains_astNode_map;
 std::map<std::pair<Z3_ast, Z3_ast>, Z3_ast> star_astNode_map; //OWN CODE
+std::map<std::pair<Z3_ast, Z3_ast>, Z3_ast> star_assert_map; //OWN CODE
+std::map<std::pair<Z3_ast, Z3_ast>, std::vector<std::pair<Z3_ast, Z3_ast> > > starUnrollMap; //OWN CODE: (owner, regex) -> Star(regex, i) unrolled for owner, with its assert
 std::map<Z3_ast, std::pair<Z3_ast, Z3_ast> > varToStarMap; //OWN CODE
 std::map<std::pair<Z3_ast, Z3_ast>, std::map<int, Z3_ast> > varForBreakConcat;
+std::map<std::pair<Z3_ast, Z3_ast>, int> arrangementLevel; //OWN CODE: (concat, concat|const) -> level its split axiom was asserted at
+std::set<std::pair<Z3_ast, Z3_ast> > arrangementPending; //OWN CODE: (concat, concat) found equal without their split asserted
+std::map<std::pair<Z3_ast, Z3_ast>, int> concatEqPairLevel; //OWN CODE: (seq rep, seq rep|const) -> level the equality was analysed at
+std::map<Z3_ast, std::vector<std::pair<std::string, Z3_ast> > > matchesAtomMap; //OWN CODE: string -> (regex, reduced Matches atom)
+std::map<Z3_ast, int> matchesLemmaAdded; //OWN CODE
+std::map<Z3_ast, Z3_ast> matchesWitnessTester; //OWN CODE: string -> tester of its automaton candidates
+std::map<Z3_ast, int> matchesWitnessLevel; //OWN CODE: string -> level its candidates were offered at
+std::map<Z3_ast, std::pair<std::string, Z3_ast> > regexAtomVarMap; //OWN CODE: var -> (regex, Matches atom the automaton decides)
+std::map<Z3_ast, T_constIndex *> constIndexMap; //OWN CODE
+std::map<Z3_ast, T_concatView *> concatViewMap; //OWN CODE
+std::map<std::vector<Z3_ast>, int> concatSeqIdMap; //OWN CODE: canonical leaf sequence -> seqId
+std::vector<Z3_ast> concatSeqRep; //OWN CODE: seqId -> first Concat built with it
+std::vector<const std::vector<Z3_ast> *> concatSeqLeaves; //OWN CODE: seqId -> its key in concatSeqIdMap
+std::map<Z3_ast, int> concatSeqRepLevel; //OWN CODE: Concat -> level its "= seq rep" axiom was asserted at
+std::map<std::pair<Z3_ast, Z3_ast>, T_strCut> strCutMap; //OWN CODE: (s, int term) -> s = prefix . rest
+std::map<Z3_ast, std::map<int, T_strCut> > strNumCutMap; //OWN CODE: s -> numeral offsets cut so far
+std::map<std::pair<Z3_ast, Z3_ast>, Z3_ast> indexofViewMap; //OWN CODE: (s, pattern) -> Indexof result
+std::map<Z3_ast, std::vector<Z3_ast> > replaceAllMap; //OWN CODE: result -> (s, pattern, replacement)
+std::map<Z3_ast, int> replaceAllLemmaLevel; //OWN CODE: lemma -> level it was asserted at
+std::map<Z3_ast, T_eqcInfo> eqcInfoMap; //OWN CODE: eqc root -> what is known about the eqc
+
+// OWN CODE: eqcInfoMap entries replaced or added at some level, put back when it is popped
+struct T_eqcInfoUndo
+{
+    int level;
+    Z3_ast root;
+    bool hadInfo;
+    T_eqcInfo info;
+};
+
+std::vector<T_eqcInfoUndo> eqcInfoTrail;
 
 //----------------------------------------------------------------
 
@@ -65,54 +99,148 @@ const std::string escapeDict[] = { "\\x00", "\\x01", "\\x02", "\\x03", "\\x04",
     "\\xe7", "\\xe8", "\\xe9", "\\xea", "\\xeb", "\\xec", "\\xed", "\\xee", "\\xef", "\\xf0", "\\xf1", "\\xf2", "\\xf3", "\\xf4", "\\xf5", "\\xf6",
     "\\xf7", "\\xf8", "\\xf9", "\\xfa", "\\xfb", "\\xfc", "\\xfd", "\\xfe", "\\xff" };
 bool avoidLoopCut = true;
+bool extractUnsatCore = false;
+bool useNielsen = false;
 
 //----------------------------------------------------------------
 // Data structure for modified algorithm
 // backtrack-able cut information
+//
+// OWN CODE: the variable set of a cut is a bitset over a dense index of the
+// nodes (cutVarList), shared between the cuts of consecutive levels and
+// copied only when a shared set is modified.
+struct T_cutVars
+{
+    int refs;
+    std::vector<unsigned long> words;
+
+    T_cutVars() {
+      refs = 1;
+    }
+};
+
 struct T_cut
 {
     int level;
-    std::map<Z3_ast, int> vars;
+    T_cutVars * vars;
 
     T_cut() {
       level = -100;
+      vars = new T_cutVars();
     }
+
+    ~T_cut() {
+      if (--vars->refs == 0)
+        delete vars;
+    }
+
+  private:
+    // private and undefined: a copy would release vars twice
+    T_cut(const T_cut &);
+    T_cut & operator=(const T_cut &);
 };
 
+#define cutWordBits ((int) (8 * sizeof(unsigned long)))
+
+std::map<Z3_ast, int> cutVarIndex;
+std::vector<Z3_ast> cutVarList;
+
 std::map<Z3_ast, std::stack<T_cut *> > cut_VARMap;
 
-void cutVarsMapCopy(std::map<Z3_ast, int> & dest, std::map<Z3_ast, int> & src) {
-  std::map<Z3_ast, int>::iterator itor = src.begin();
-  for (; itor != src.end(); itor++) {
-    dest[itor->first] = 1;
+//----------------------------------------------------------------
+// OWN CODE: split points of (Concat x y) = "long constant" that are
+// materialised lazily, a window at a time, keyed on Length(x).
+// windows: (level the window was asserted at, first split point after it)
+// reached: furthest split point ever needed, restored at once after a pop
+struct T_concatSplit
+{
+    Z3_ast arg1;
+    Z3_ast arg2;
+    std::vector<std::pair<int, int> > windows;
+    int reached;
+
+    T_concatSplit() {
+      arg1 = NULL;
+      arg2 = NULL;
+      reached = 0;
+    }
+};
+
+#define lazySplitMinLength 64
+#define lazySplitWindow 32
+
+std::map<std::pair<Z3_ast, Z3_ast>, T_concatSplit> pendingConcatSplit;
+
+int cutVarId(Z3_ast node) {
+  std::map<Z3_ast, int>::iterator itor = cutVarIndex.find(node);
+  if (itor != cutVarIndex.end())
+    return itor->second;
+  int id = cutVarList.size();
+  cutVarIndex[node] = id;
+  cutVarList.push_back(node);
+  return id;
+}
+
+/*
+ * A cut for a new level starts out sharing the variable set of the one below
+ */
+T_cut * cutShare(T_cut * below, int slevel) {
+  T_cut * varInfo = new T_cut();
+  varInfo->level = slevel;
+  delete varInfo->vars;
+  varInfo->vars = below->vars;
+  varInfo->vars->refs++;
+  return varInfo;
+}
+
+/*
+ * Make the variable set of a cut private to it before changing it
+ */
+T_cutVars * cutVarsWritable(T_cut * cut) {
+  if (cut->vars->refs > 1) {
+    T_cutVars * copy = new T_cutVars();
+    copy->words = cut->vars->words;
+    cut->vars->refs--;
+    cut->vars = copy;
   }
+  return cut->vars;
+}
+
+void cutVarsAdd(T_cut * cut, Z3_ast node) {
+  int id = cutVarId(node);
+  T_cutVars * vars = cutVarsWritable(cut);
+  if ((int) vars->words.size() <= id / cutWordBits)
+    vars->words.resize(id / cutWordBits + 1, 0);
+  vars->words[id / cutWordBits] |= 1UL << (id % cutWordBits);
+}
+
+void cutVarsUnion(T_cut * cut, const T_cutVars * src) {
+  if (cut->vars == src)
+    return;
+  T_cutVars * vars = cutVarsWritable(cut);
+  if (vars->words.size() < src->words.size())
+    vars->words.resize(src->words.size(), 0);
+  for (unsigned int i = 0; i < src->words.size(); i++)
+    vars->words[i] |= src->words[i];
 }
 
 void addCutInfoOneNode(Z3_ast baseNode, int slevel, Z3_ast node) {
-  if (cut_VARMap.find(baseNode) == cut_VARMap.end()) {
+  std::stack<T_cut *> & cuts = cut_VARMap[baseNode];
+  if (cuts.empty()) {
     T_cut * varInfo = new T_cut();
     varInfo->level = slevel;
-    varInfo->vars[node] = 1;
-    cut_VARMap[baseNode].push(varInfo);
+    cutVarsAdd(varInfo, node);
+    cuts.push(varInfo);
   } else {
-    if (cut_VARMap[baseNode].empty()) {
-      T_cut * varInfo = new T_cut();
-      varInfo->level = slevel;
-      varInfo->vars[node] = 1;
-      cut_VARMap[baseNode].push(varInfo);
+    if (cuts.top()->level < slevel) {
+      T_cut * varInfo = cutShare(cuts.top(), slevel);
+      cutVarsAdd(varInfo, node);
+      cuts.push(varInfo);
+    } else if (cuts.top()->level == slevel) {
+      cutVarsAdd(cuts.top(), node);
     } else {
-      if (cut_VARMap[baseNode].top()->level < slevel) {
-        T_cut * varInfo = new T_cut();
-        varInfo->level = slevel;
-        cutVarsMapCopy(varInfo->vars, cut_VARMap[baseNode].top()->vars);
-        varInfo->vars[node] = 1;
-        cut_VARMap[baseNode].push(varInfo);
-      } else if (cut_VARMap[baseNode].top()->level == slevel) {
-        cut_VARMap[baseNode].top()->vars[node] = 1;
-      } else {
-        printf("should not be here. exit %d\n", __LINE__);
-        exit(0);
-      }
+      printf("should not be here. exit %d\n", __LINE__);
+      exit(0);
     }
   }
 }
@@ -128,24 +256,19 @@ void addCutInfoMerge(Z3_ast destNode, int slevel, Z3_ast srcNode) {
     exit(0);
   }
 
-  if (cut_VARMap.find(destNode) == cut_VARMap.end()) {
-    T_cut * varInfo = new T_cut();
-    varInfo->level = slevel;
-    cutVarsMapCopy(varInfo->vars, cut_VARMap[srcNode].top()->vars);
-    cut_VARMap[destNode].push(varInfo);
+  T_cut * srcCut = cut_VARMap[srcNode].top();
+  std::stack<T_cut *> & cuts = cut_VARMap[destNode];
+  if (cuts.empty()) {
+    cuts.push(cutShare(srcCut, slevel));
+  } else if (cuts.top()->level < slevel) {
+    T_cut * varInfo = cutShare(cuts.top(), slevel);
+    cutVarsUnion(varInfo, srcCut->vars);
+    cuts.push(varInfo);
+  } else if (cuts.top()->level == slevel) {
+    cutVarsUnion(cuts.top(), srcCut->vars);
   } else {
-    if (cut_VARMap[destNode].empty() || cut_VARMap[destNode].top()->level < slevel) {
-      T_cut * varInfo = new T_cut();
-      varInfo->level = slevel;
-      cutVarsMapCopy(varInfo->vars, cut_VARMap[destNode].top()->vars);
-      cutVarsMapCopy(varInfo->vars, cut_VARMap[srcNode].top()->vars);
-      cut_VARMap[destNode].push(varInfo);
-    } else if (cut_VARMap[destNode].top()->level == slevel) {
-      cutVarsMapCopy(cut_VARMap[destNode].top()->vars, cut_VARMap[srcNode].top()->vars);
-    } else {
-      printf("should not be here. exit %d\n", __LINE__);
-      exit(0);
-    }
+    printf("should not be here. exit %d\n", __LINE__);
+    exit(0);
   }
 }
 
@@ -163,18 +286,19 @@ void checkandInit_cutVAR(Z3_theory t, Z3_ast node) {
 }
 
 bool hasSelfCut(Z3_ast n1, Z3_ast n2) {
-  if (cut_VARMap.find(n1) == cut_VARMap.end())
+  std::map<Z3_ast, std::stack<T_cut *> >::iterator itor1 = cut_VARMap.find(n1);
+  if (itor1 == cut_VARMap.end() || itor1->second.empty())
     return false;
 
-  if (cut_VARMap.find(n2) == cut_VARMap.end())
+  std::map<Z3_ast, std::stack<T_cut *> >::iterator itor2 = cut_VARMap.find(n2);
+  if (itor2 == cut_VARMap.end() || itor2->second.empty())
     return false;
 
-  if (cut_VARMap[n1].empty() || cut_VARMap[n2].empty())
-    return false;
-
-  std::map<Z3_ast, int>::iterator itor = cut_VARMap[n1].top()->vars.begin();
-  for (; itor != cut_VARMap[n1].top()->vars.end(); itor++) {
-    if (cut_VARMap[n2].top()->vars.find(itor->first) != cut_VARMap[n2].top()->vars.end())
+  const std::vector<unsigned long> & words1 = itor1->second.top()->vars->words;
+  const std::vector<unsigned long> & words2 = itor2->second.top()->vars->words;
+  unsigned int count = std::min(words1.size(), words2.size());
+  for (unsigned int i = 0; i < count; i++) {
+    if ((words1[i] & words2[i]) != 0)
       return true;
   }
   return false;
@@ -195,10 +319,12 @@ void printCutVAR(Z3_theory t, Z3_ast node) {
     if (! cut_VARMap[node].empty())
     {
       __debugPrint(logFile, "[%2d] {", cut_VARMap[node].top()->level);
-      std::map<Z3_ast, int>::iterator itor = cut_VARMap[node].top()->vars.begin();
-      for (; itor != cut_VARMap[node].top()->vars.end(); itor++) {
-        printZ3Node(t, itor->first);
-        __debugPrint(logFile, ", ");
+      const std::vector<unsigned long> & words = cut_VARMap[node].top()->vars->words;
+      for (int id = 0; id < (int) words.size() * cutWordBits; id++) {
+        if (words[id / cutWordBits] & (1UL << (id % cutWordBits))) {
+          printZ3Node(t, cutVarList[id]);
+          __debugPrint(logFile, ", ");
+        }
       }
       __debugPrint(logFile, "}\n");
     }
@@ -212,6 +338,96 @@ void printCutVAR(Z3_theory t, Z3_ast node) {
 }
 
 //----------------------------------------------------------------
+/*
+ * Drop all theory state kept in globals, so that a new context can be
+ * created in the same process (used by the embedding API in z3str.cpp).
+ * Z3_ast keys of the old context are dangling after Z3_del_context.
+ */
+void resetStrTheoryState() {
+  sLevel = 0;
+  searchStart = 0;
+  tmpStringVarCount = 0;
+  tmpRegexVarCount = 0;
+  tmpIntVarCount = 0;
+  tmpXorVarCount = 0;
+  tmpBoolVarCount = 0;
+  tmpConcatCount = 0;
+  loopDetected = false;
+
+  constStr_astNode_map.clear();
+  regex_astNode_map.clear();
+  matchesAtomMap.clear();
+  matchesLemmaAdded.clear();
+  regexAtomVarMap.clear();
+  length_astNode_map.clear();
+  containsReduced_bool_str_map.clear();
+  containsReduced_bool_subStr_map.clear();
+  basicStrVarAxiom_added.clear();
+  concat_eqc_index.clear();
+  simple_regex_map.clear();
+  concat_astNode_map.clear();
+  contains_astNode_map.clear();
+  star_astNode_map.clear();
+  star_assert_map.clear();
+  starUnrollMap.clear();
+  varToStarMap.clear();
+  varForBreakConcat.clear();
+  arrangementLevel.clear();
+  arrangementPending.clear();
+  inputVarMap.clear();
+
+  fvarLenCountMap.clear();
+  fvarLenTesterMap.clear();
+  lenTesterFvarMap.clear();
+  fvarValueTesterMap.clear();
+  valRangeMap.clear();
+  valueTesterFvarMap.clear();
+  fvarStarCountMap.clear();
+  matchesWitnessTester.clear();
+  matchesWitnessLevel.clear();
+
+  std::map<Z3_ast, std::stack<T_cut *> >::iterator varItor = cut_VARMap.begin();
+  for (; varItor != cut_VARMap.end(); varItor++) {
+    while (!varItor->second.empty()) {
+      delete varItor->second.top();
+      varItor->second.pop();
+    }
+  }
+  cut_VARMap.clear();
+  cutVarIndex.clear();
+  cutVarList.clear();
+  pendingConcatSplit.clear();
+
+  std::map<Z3_ast, T_constIndex *>::iterator constIndexItor = constIndexMap.begin();
+  for (; constIndexItor != constIndexMap.end(); constIndexItor++)
+    delete constIndexItor->second;
+  constIndexMap.clear();
+
+  std::map<Z3_ast, T_concatView *>::iterator viewItor = concatViewMap.begin();
+  for (; viewItor != concatViewMap.end(); viewItor++)
+    delete viewItor->second;
+  concatViewMap.clear();
+  concatSeqIdMap.clear();
+  concatEqPairLevel.clear();
+  strCutMap.clear();
+  strNumCutMap.clear();
+  indexofViewMap.clear();
+  replaceAllMap.clear();
+  replaceAllLemmaLevel.clear();
+  eqcInfoMap.clear();
+  eqcInfoTrail.clear();
+  concatSeqRep.clear();
+  concatSeqLeaves.clear();
+  concatSeqRepLevel.clear();
+
+  if (charSet != NULL) {
+    delete[] charSet;
+    charSet = NULL;
+  }
+  charSetSize = 0;
+  charSetLookupTable.clear();
+}
+
 /*
  *
  */
@@ -600,7 +816,7 @@ T_myZ3Type getNodeType(Z3_theory t, Z3_ast n) {
           }
         } else if (sk == Z3_UNKNOWN_SORT) {
           if (s == td->String) {
-            if (d == td->Concat || d == td->SubString || d == td->Replace || d == td->Star) {
+            if (d == td->Concat || d == td->SubString || d == td->Replace || d == td->ReplaceAll || d == td->Star) {
               return my_Z3_Func;
             } else {
               return my_Z3_ConstStr;
@@ -734,10 +950,29 @@ inline bool isSimpleRegex(Z3_theory t, Z3_ast node){
   }
 }
 
+/*
+ * OWN CODE
+ * Syntax for every boost::regex built here. no_mod_m keeps '^' / '$' at the
+ * ends of the string, the meaning the regex parser gives them.
+ */
+const boost::regex::flag_type boostRegexFlags = boost::regex::perl | boost::regex::no_mod_m;
+
+/*
+ * OWN CODE
+ * Whether const_str[begin, end) matches the regex: read from the shared
+ * match-position index, boost is only used when there is no index
+ */
+bool substrMatchesRegex(T_regexMatchIndex * index, const boost::regex & regexTemp, const std::string & const_str, int begin, int end){
+  if (index != NULL){
+    return regexMatchesSubstr(index, begin, end);
+  }
+  return boost::regex_match(const_str.substr(begin, end - begin), regexTemp);
+}
+
 /*
  * OWN_CODE
  */
-void getStarableFromStart(int * * dp, const boost::regex & regexTemp, const std::string & const_str){
+void getStarableFromStart(int * * dp, const std::string & regexStr, const std::string & const_str){
   int length_const_str = (int) const_str.size();
   if (dp == NULL){
 #ifdef DEBUGLOG
@@ -759,16 +994,21 @@ void getStarableFromStart(int * * dp, const boost::regex & regexTemp, const std:
     }
   }
 
+  T_regexMatchIndex * index = getRegexMatchIndex(regexStr, const_str);
+  boost::regex regexTemp;
+  if (index == NULL){
+    regexTemp.assign(regexStr, boostRegexFlags);
+  }
   for (int id_dp = 0; id_dp < length_const_str; ++ id_dp){
-    std::string strTemp = const_str.substr(0, id_dp + 1);
-    if (boost::regex_match(strTemp, regexTemp)){
+    if (substrMatchesRegex(index, regexTemp, const_str, 0, id_dp + 1)){
       dp[id_dp][0] = 1;
     }
     for (int id_const_str = 0; id_const_str < id_dp; ++ id_const_str){
-      strTemp = const_str.substr(id_const_str + 1, id_dp - id_const_str);
-      if (boost::regex_match(strTemp, regexTemp)){
+      if (substrMatchesRegex(index, regexTemp, const_str, id_const_str + 1, id_dp + 1)){
         for (int id_dp2 = 0; id_dp2 < length_const_str - 1; ++ id_dp2){
-           dp[id_dp][id_dp2 + 1] = dp[id_const_str][id_dp2];
+          if (dp[id_const_str][id_dp2] == 1){
+            dp[id_dp][id_dp2 + 1] = 1;
+          }
         }
       }
     }
@@ -791,7 +1031,7 @@ void getStarableFromStart(int * * dp, const boost::regex & regexTemp, const std:
 /*
  * OWN CODE
  */
-void getStarableFromEnd(int * * dp, const boost::regex & regexTemp, const std::string & const_str){
+void getStarableFromEnd(int * * dp, const std::string & regexStr, const std::string & const_str){
   int length_const_str = (int) const_str.size();
   if (dp == NULL){
 #ifdef DEBUGLOG
@@ -813,17 +1053,22 @@ void getStarableFromEnd(int * * dp, const boost::regex & regexTemp, const std::s
     }
   }
 
+  T_regexMatchIndex * index = getRegexMatchIndex(regexStr, const_str);
+  boost::regex regexTemp;
+  if (index == NULL){
+    regexTemp.assign(regexStr, boostRegexFlags);
+  }
   for (int id_dp = length_const_str - 1; id_dp >= 0; -- id_dp){
-    std::string strTemp = const_str.substr(id_dp, length_const_str - id_dp);
-
-    if (boost::regex_match(strTemp, regexTemp)){
+    if (substrMatchesRegex(index, regexTemp, const_str, id_dp, length_const_str)){
       dp[id_dp][0] = 1;
     }
-    for (int id_const_str = length_const_str - 1; id_const_str > id_dp; -- id_const_str){
-      strTemp = const_str.substr(id_dp, id_const_str - id_dp + 1);
-      if (boost::regex_match(strTemp, regexTemp)){
+    // const_str[id_dp, id_const_str] matches, the rest starts at id_const_str + 1
+    for (int id_const_str = length_const_str - 2; id_const_str >= id_dp; -- id_const_str){
+      if (substrMatchesRegex(index, regexTemp, const_str, id_dp, id_const_str + 1)){
         for (int id_dp2 = 0; id_dp2 < length_const_str - 1; ++ id_dp2){
-           dp[id_dp][id_dp2 + 1] = dp[id_const_str][id_dp2];
+          if (dp[id_const_str + 1][id_dp2] == 1){
+            dp[id_dp][id_dp2 + 1] = 1;
+          }
         }
       }
     }
@@ -907,8 +1152,37 @@ Z3_ast mk_contains(Z3_theory t, Z3_ast n1, Z3_ast n2) {
 
 /*
  * OWN CODE
+ * Star(n1, count) unrolled as Concat(Star(n1, count - 1), fresh n1) for owner.
+ * The unrollings of one owner extend each other, so trying count + 1 adds a
+ * single copy of n1. Another owner gets copies of its own: its string is free
+ * to differ.
  */
-Z3_ast mk_star(Z3_theory t, Z3_ast n1, Z3_ast n2, Z3_ast & assert) {
+Z3_ast unrollStar(Z3_theory t, Z3_ast owner, Z3_ast n1, int count, Z3_ast & assert) {
+  std::vector<std::pair<Z3_ast, Z3_ast> > & prefixes = starUnrollMap[std::make_pair(owner, n1)];
+  if (prefixes.empty()) {
+    prefixes.push_back(std::make_pair(my_mk_str_value(t, ""), (Z3_ast) NULL));
+  }
+  std::string regexStr = getRegexString(t, n1);
+  while ((int) prefixes.size() <= count) {
+    Z3_ast itemAssert = NULL;
+    Z3_ast item = regex_parse(t, regexStr, itemAssert);
+    if (item == NULL) {
+      assert = NULL;
+      return NULL;
+    }
+    Z3_ast prefix = mk_concat(t, prefixes.back().first, simplifyConcat1(t, item));
+    prefixes.push_back(std::make_pair(prefix, mk_2_and(t, prefixes.back().second, itemAssert)));
+  }
+  assert = prefixes[count].second;
+  return prefixes[count].first;
+}
+
+/*
+ * OWN CODE
+ * owner: the Star term a constant count is tried for, see unrollStar. Without
+ * one, Star(n1, n2) is a term of its own and does not share Star(n1, n2 - 1).
+ */
+Z3_ast mk_star(Z3_theory t, Z3_ast n1, Z3_ast n2, Z3_ast & assert, Z3_ast owner) {
 #ifdef DEBUGLOG
   __debugPrint(logFile, "mk_star(): n1 = ");
   printZ3Node(t, n1);
@@ -945,11 +1219,14 @@ Z3_ast mk_star(Z3_theory t, Z3_ast n1, Z3_ast n2, Z3_ast & assert) {
   PATheoryData * td = (PATheoryData*) Z3_theory_get_ext_data(t);
   std::pair<Z3_ast, Z3_ast> starKey(n1, n2);
   std::map<std::pair<Z3_ast, Z3_ast>, Z3_ast>::iterator it = star_astNode_map.find(starKey);
-  if (it == star_astNode_map.end()) {
+  if (owner == NULL && it != star_astNode_map.end()) {
+    assert = star_assert_map[starKey];
+    return it->second;
+  } else {
     Z3_ast starAst = NULL;
     if (isSimpleRegex(t, n1) && isConstInt(t, n2)) {
       int intVal = getConstIntValue(t, n2);
-      std::string n1Str = "(" + getStringMatchesSimpleRegex(t, n1) + ")";
+      std::string n1Str = getStringMatchesSimpleRegex(t, n1);
       std::string result = ""; 
       for (int id = 0; id < intVal; ++ id){
         result += n1Str;
@@ -960,21 +1237,17 @@ Z3_ast mk_star(Z3_theory t, Z3_ast n1, Z3_ast n2, Z3_ast & assert) {
     } else if (isConstInt(t, n2) && getConstIntValue(t, n2) == 0){
       starAst = my_mk_str_value(t, "");
     } else if (isConstInt(t, n2)) {
-      int repeatTimes = getConstIntValue(t, n2);
-      std::string tempRegex = "";
-      std::string regexInStar = "(" + getRegexString(t, n1) + ")";
-      for (int id = 0; id < repeatTimes; ++ id){
-        tempRegex = tempRegex + regexInStar;
-      }
-      starAst = simplifyConcat1(t, regex_parse(t, tempRegex, assert));
+      // a constant count without an owner owns its unrolling
+      starAst = unrollStar(t, (owner == NULL) ? n2 : owner, n1, getConstIntValue(t, n2), assert);
     } else {
       starAst = mk_2_arg_app(ctx, td->Star, n1, n2);
       assert = Z3_mk_ge(ctx, n2, mk_int(ctx, 0));
     }
-    star_astNode_map[starKey] = starAst;
+    if (owner == NULL) {
+      star_astNode_map[starKey] = starAst;
+      star_assert_map[starKey] = assert;
+    }
     return starAst;
-  } else {
-    return it->second;
   }
 }
 
@@ -1156,6 +1429,14 @@ Z3_ast mk_concat(Z3_theory t, Z3_ast n1, Z3_ast n2) {
     } else {
       concatAst = concat_astNode_map[concatArgs];
     }
+
+    // OWN CODE: associativity variants of one sequence go into one eqc. A pop
+    // retracts the axiom, so a Concat from the cache may need it again.
+    Z3_ast seqRep = concatSeqRep[getConcatView(t, concatAst)->seqId];
+    if (seqRep != concatAst && concatSeqRepLevel.find(concatAst) == concatSeqRepLevel.end()) {
+      concatSeqRepLevel[concatAst] = sLevel;
+      addAxiom(t, Z3_mk_eq(ctx, concatAst, seqRep), __LINE__);
+    }
     return concatAst;
   }
 }
@@ -1197,6 +1478,47 @@ void addAxiom(Z3_theory t, Z3_ast toAssert, int line, bool display) {
   }
 }
 
+/*
+ * OWN CODE
+ * The split axiom of n1 = n2 stays asserted until the level it was added at
+ * is popped (cb_pop forgets it then). Until that happens, new_eq callbacks for
+ * the same pair can skip building the arrangement again. The core ignores an
+ * axiom already asserted in the current scope, so a rebuild from final check
+ * costs only the work of building it.
+ */
+bool arrangementLive(Z3_ast n1, Z3_ast n2) {
+  return arrangementLevel.find(std::make_pair(n1, n2)) != arrangementLevel.end()
+      || arrangementLevel.find(std::make_pair(n2, n1)) != arrangementLevel.end();
+}
+
+void addArrangementAxiom(Z3_theory t, Z3_ast n1, Z3_ast n2, Z3_ast toAssert, int line) {
+  arrangementLevel[std::make_pair(n1, n2)] = sLevel;
+  addAxiom(t, toAssert, line);
+}
+
+/*
+ * OWN CODE
+ * new_eq does not split again two Concats that concat_eqc_index has seen
+ * both of, and a split from final check is popped while the Concats may stay
+ * equal. Such pairs, split before but not now, are pending. When the split
+ * chosen by final check is still asserted, final check adds nothing and the
+ * core would accept the model, so the pending pairs that are still equal are
+ * split instead. A pair that is split or no longer equal is dropped: merging
+ * it again goes through new_eq, which puts it back.
+ */
+void splitPendingArrangements(Z3_theory t) {
+  std::vector<std::pair<Z3_ast, Z3_ast> > pending(arrangementPending.begin(), arrangementPending.end());
+  arrangementPending.clear();
+  for (unsigned int i = 0; i < pending.size(); i++) {
+    Z3_ast n1 = pending[i].first;
+    Z3_ast n2 = pending[i].second;
+    if (arrangementLive(n1, n2) || !inSameEqc(t, n1, n2))
+      continue;
+    __debugPrint(logFile, ">> Split a pending Concat equality @ %d\n", __LINE__);
+    simplifyConcatEq(t, n1, n2, 0);
+  }
+}
+
 /*
  *
  */
@@ -1275,6 +1597,90 @@ void __printZ3Node(Z3_theory t, Z3_ast node) {
 #endif
 }
 
+/*
+ * OWN CODE
+ */
+void setEqcInfo(Z3_ast root, const T_eqcInfo & info) {
+  T_eqcInfoUndo undo;
+  undo.level = sLevel;
+  undo.root = root;
+  std::map<Z3_ast, T_eqcInfo>::iterator itor = eqcInfoMap.find(root);
+  undo.hadInfo = (itor != eqcInfoMap.end());
+  if (undo.hadInfo)
+    undo.info = itor->second;
+  eqcInfoTrail.push_back(undo);
+  eqcInfoMap[root] = info;
+}
+
+T_eqcInfo computeEqcInfo(Z3_theory t, Z3_ast n) {
+  T_eqcInfo info;
+  info.value = NULL;
+  info.empty = false;
+  info.length = -1;
+  Z3_ast curr = n;
+  do {
+    if (Z3_theory_is_value(t, curr)) {
+      if (isConstStr(t, curr)) {
+        info.value = curr;
+        break;
+      }
+    }
+    curr = Z3_theory_get_eqc_next(t, curr);
+  } while (curr != n);
+  if (info.value != NULL) {
+    info.empty = (info.value == my_mk_str_value(t, ""));
+    info.length = getConstStrValue(t, info.value).length();
+  }
+  return info;
+}
+
+/*
+ * OWN CODE
+ * The eqc of n: its constant (NULL if none), whether that is "" and its
+ * length (-1 without a constant). Cached under the eqc root once the search
+ * has started, see mergeEqcInfo() and cb_pop().
+ */
+T_eqcInfo getEqcInfo(Z3_theory t, Z3_ast n) {
+  if (searchStart == 0)
+    return computeEqcInfo(t, n);
+  Z3_ast root = Z3_theory_get_eqc_root(t, n);
+  std::map<Z3_ast, T_eqcInfo>::iterator itor = eqcInfoMap.find(root);
+  if (itor != eqcInfoMap.end())
+    return itor->second;
+  T_eqcInfo info = computeEqcInfo(t, n);
+  setEqcInfo(root, info);
+  return info;
+}
+
+bool eqcHasConst(Z3_theory t, Z3_ast n) {
+  return getEqcInfo(t, n).value != NULL;
+}
+
+bool eqcIsEmptyStr(Z3_theory t, Z3_ast n) {
+  return getEqcInfo(t, n).empty;
+}
+
+int eqcConstLength(Z3_theory t, Z3_ast n) {
+  return getEqcInfo(t, n).length;
+}
+
+/*
+ * OWN CODE
+ * The theory merges the eqcs of nn1 and nn2 right after cb_new_eq. Whichever
+ * root survives, it finds the merged status.
+ */
+void mergeEqcInfo(Z3_theory t, Z3_ast nn1, Z3_ast nn2) {
+  Z3_ast root1 = Z3_theory_get_eqc_root(t, nn1);
+  Z3_ast root2 = Z3_theory_get_eqc_root(t, nn2);
+  if (root1 == root2)
+    return;
+  T_eqcInfo info1 = getEqcInfo(t, nn1);
+  T_eqcInfo info2 = getEqcInfo(t, nn2);
+  T_eqcInfo merged = (info1.value != NULL) ? info1 : info2;
+  setEqcInfo(root1, merged);
+  setEqcInfo(root2, merged);
+}
+
 /*
  * Look for the equivalent constant for a node "n"
  * Iterate the equivalence class
@@ -1284,15 +1690,8 @@ void __printZ3Node(Z3_theory t, Z3_ast node) {
  *    return n
  */
 Z3_ast get_eqc_value(Z3_theory t, Z3_ast n) {
-  Z3_ast curr = n;
-  do {
-    if (Z3_theory_is_value(t, curr)) {
-      if (isConstStr(t, curr))
-        return curr;
-    }
-    curr = Z3_theory_get_eqc_next(t, curr);
-  } while (curr != n);
-  return n;
+  Z3_ast value = getEqcInfo(t, n).value;
+  return (value != NULL) ? value : n;
 }
 
 /*
@@ -1427,7 +1826,7 @@ std::string getRegexString(Z3_theory t, Z3_ast n){
  * if it is not a valid regex return "__NotRegex__"
  */
 boost::regex getRegexValue(Z3_theory t, Z3_ast n){
-  return boost::regex(getRegexString(t, n));
+  return boost::regex(getRegexString(t, n), boostRegexFlags);
 }
 
 /*
@@ -1461,19 +1860,17 @@ inline int getConstIntValue(Z3_theory t, Z3_ast n) {
  *
  */
 Z3_ast Concat(Z3_theory t, Z3_ast n1, Z3_ast n2) {
-  Z3_ast v1 = get_eqc_value(t, n1);
-  Z3_ast v2 = get_eqc_value(t, n2);
-  if (isConstStr(t, v1) && isConstStr(t, v2)) {
-    std::string n1_str = getConstStrValue(t, v1);
-    std::string n2_str = getConstStrValue(t, v2);
+  T_eqcInfo info1 = getEqcInfo(t, n1);
+  T_eqcInfo info2 = getEqcInfo(t, n2);
+  if (info1.value != NULL && info2.value != NULL) {
+    std::string n1_str = getConstStrValue(t, info1.value);
+    std::string n2_str = getConstStrValue(t, info2.value);
     std::string result = n1_str + n2_str;
     return my_mk_str_value(t, result.c_str());
-  } else if (isConstStr(t, v1) && !isConstStr(t, v2)) {
-    if (getConstStrValue(t, v1) == "")
-      return n2;
-  } else if (!isConstStr(t, v1) && isConstStr(t, v2)) {
-    if (getConstStrValue(t, v2) == "")
-      return n1;
+  } else if (info1.empty) {
+    return n2;
+  } else if (info2.empty) {
+    return n1;
   }
   return NULL;
 }
@@ -1689,29 +2086,50 @@ void simplifyConcatStr(Z3_theory t, Z3_ast nn, Z3_ast eq_str) {
 /*
  * Check whether Concat(a, b) can equal to a constant string
  */
-int canConcatEqStr(Z3_theory t, Z3_ast concat, std::string str) {
-  int strLen = str.length();
+int canConcatEqStr(Z3_theory t, Z3_ast concat, const std::string & str) {
+  return canConcatEqStr(t, concat, str, 0, str.length());
+}
+
+/*
+ * OWN CODE
+ * Same check against str[begin, begin + strLen), without copying it out
+ */
+int canConcatEqStr(Z3_theory t, Z3_ast concat, const std::string & str, int begin, int strLen) {
   if (isConcatFunc(t, concat)) {
-    Z3_ast ml_node = getMostLeftNodeInConcat(t, concat);
-    if (isConstStr(t, ml_node)) {
-      std::string ml_str = getConstStrValue(t, ml_node);
-      int ml_len = ml_str.length();
-      if (ml_len > strLen)
-        return 0;
-      int cLen = ml_len;
-      if (ml_str != str.substr(0, cLen))
+    const T_concatView * view = getConcatView(t, concat);
+    if (view->constLength > strLen)
+      return 0;
+
+    // OWN CODE: the constant pieces have to appear in str in order, the first
+    // one as a prefix and the last one as a suffix when nothing is around them
+    const std::vector<const T_constIndex *> & pieces = view->constPieces;
+    int from = begin;
+    int to = begin + strLen;
+    unsigned int first = 0;
+    unsigned int last = pieces.size();
+    // a single piece that is both first and last is the whole sequence
+    if (view->constFirst && view->constLast && last == 1)
+      return (str.compare(begin, strLen, pieces[0]->value) == 0) ? 1 : 0;
+    if (view->constFirst && first < last) {
+      const std::string & ml_str = pieces[first]->value;
+      if (str.compare(begin, ml_str.length(), ml_str) != 0)
         return 0;
+      from += ml_str.length();
+      first++;
     }
-
-    Z3_ast mr_node = getMostRightNodeInConcat(t, concat);
-    if (isConstStr(t, mr_node)) {
-      std::string mr_str = getConstStrValue(t, mr_node);
+    if (view->constLast && first < last) {
+      const std::string & mr_str = pieces[last - 1]->value;
       int mr_len = mr_str.length();
-      if (mr_len > strLen)
+      if (mr_len > to - from || str.compare(to - mr_len, mr_len, mr_str) != 0)
         return 0;
-      int cLen = mr_len;
-      if (mr_str != str.substr(strLen - cLen, cLen))
+      to -= mr_len;
+      last--;
+    }
+    for (unsigned int i = first; i < last; i++) {
+      int pos = constIndexFind(pieces[i], str, from, to);
+      if (pos == -1)
         return 0;
+      from = pos + pieces[i]->value.length();
     }
   }
   return 1;
@@ -1724,33 +2142,25 @@ int canConcatEqStr(Z3_theory t, Z3_ast concat, std::string str) {
 int canConcatEqConcat(Z3_theory t, Z3_ast concat1, Z3_ast concat2) {
   // make sure left and right are concat functions
   if (isConcatFunc(t, concat1) && isConcatFunc(t, concat2)) {
-    {
-      // Suppose concat1 = concat(x, y), concat2 = concat(m, n)
-      Z3_ast concat1_mostL = getMostLeftNodeInConcat(t, concat1);
-      Z3_ast concat2_mostL = getMostLeftNodeInConcat(t, concat2);
-      // if both x and m are const strings, check whether they have the same prefix
-      if (isConstStr(t, concat1_mostL) && isConstStr(t, concat2_mostL)) {
-
-        std::string concat1_mostL_str = getConstStrValue(t, concat1_mostL);
-        std::string concat2_mostL_str = getConstStrValue(t, concat2_mostL);
-        int cLen = std::min(concat1_mostL_str.length(), concat2_mostL_str.length());
-        if (concat1_mostL_str.substr(0, cLen) != concat2_mostL_str.substr(0, cLen)) {
-          return 0;
-        }
+    const T_concatView * view1 = getConcatView(t, concat1);
+    const T_concatView * view2 = getConcatView(t, concat2);
+    // if both start with constants, check whether they have the same prefix
+    if (view1->constFirst && view2->constFirst) {
+      const std::string & concat1_mostL_str = view1->constPieces.front()->value;
+      const std::string & concat2_mostL_str = view2->constPieces.front()->value;
+      int cLen = std::min(concat1_mostL_str.length(), concat2_mostL_str.length());
+      if (concat1_mostL_str.compare(0, cLen, concat2_mostL_str, 0, cLen) != 0) {
+        return 0;
       }
     }
 
-    {
-      Z3_ast concat1_mostR = getMostRightNodeInConcat(t, concat1);
-      Z3_ast concat2_mostR = getMostRightNodeInConcat(t, concat2);
-      // if both m and n are const strings, check whether they have the same suffix
-      if (isConstStr(t, concat1_mostR) && isConstStr(t, concat2_mostR)) {
-        std::string concat1_mostR_str = getConstStrValue(t, concat1_mostR);
-        std::string concat2_mostR_str = getConstStrValue(t, concat2_mostR);
-        int cLen = std::min(concat1_mostR_str.length(), concat2_mostR_str.length());
-        if (concat1_mostR_str.substr(concat1_mostR_str.length() - cLen, cLen) != concat2_mostR_str.substr(concat2_mostR_str.length() - cLen, cLen)) {
-          return 0;
-        }
+    // if both end with constants, check whether they have the same suffix
+    if (view1->constLast && view2->constLast) {
+      const std::string & concat1_mostR_str = view1->constPieces.back()->value;
+      const std::string & concat2_mostR_str = view2->constPieces.back()->value;
+      int cLen = std::min(concat1_mostR_str.length(), concat2_mostR_str.length());
+      if (concat1_mostR_str.compare(concat1_mostR_str.length() - cLen, cLen, concat2_mostR_str, concat2_mostR_str.length() - cLen, cLen) != 0) {
+        return 0;
       }
     }
   }
@@ -1852,14 +2262,12 @@ void solve_star_eq_str(Z3_theory t, Z3_ast starAst, Z3_ast constStr) {
       return;
     }
     
-    boost::regex regexTemp = getRegexValue(t, arg1);
-    
     int * * dp = new int * [length_const_str];
     for (int id_dp = 0; id_dp < length_const_str; ++ id_dp){
       dp[id_dp] = new int [length_const_str];
     }
     
-    getStarableFromStart(dp, regexTemp, const_str);
+    getStarableFromStart(dp, getRegexString(t, arg1), const_str);
     
     if (isConstInt(t, arg2)){
       int const_arg2 = getConstIntValue(t, arg2);
@@ -1907,6 +2315,189 @@ void solve_star_eq_str(Z3_theory t, Z3_ast starAst, Z3_ast constStr) {
 //    constStr == Concat( constrStr, xx )
 //    constStr == Concat( xx, constrStr )
 //------------------------------------------------------------
+/*
+ * OWN CODE
+ * Materialise split points [from, to) of (Concat arg1 arg2) = constStr:
+ *   concatAst = constStr /\ Length(arg1) = i  =>  arg1 = prefix_i /\ arg2 = suffix_i
+ * Split points ruled out by canConcatEqStr only exclude the length.
+ */
+void genConcatSplitWindow(Z3_theory t, Z3_ast concatAst, Z3_ast constStr, Z3_ast arg1, Z3_ast arg2, int from, int to) {
+  Z3_context ctx = Z3_theory_get_context(t);
+  std::string const_str = getConstStrValue(t, constStr);
+  int concatStrLen = const_str.length();
+  if (to > concatStrLen + 1)
+    to = concatStrLen + 1;
+  if (from >= to)
+    return;
+
+#ifdef DEBUGLOG
+  __debugPrint(logFile, ">> genConcatSplitWindow [%d, %d) of %d: ", from, to, concatStrLen);
+  printZ3Node(t, concatAst);
+  __debugPrint(logFile, "\n");
+#endif
+
+  Z3_ast arg1Len = mk_length(t, arg1);
+  Z3_ast * and_items = new Z3_ast[to - from];
+  int and_count = 0;
+  for (int i = from; i < to; i++) {
+    std::string prefixStr = const_str.substr(0, i);
+    std::string suffixStr = const_str.substr(i, concatStrLen - i);
+    Z3_ast lenEq = Z3_mk_eq(ctx, arg1Len, mk_int(ctx, i));
+
+    if ((isConcatFunc(t, arg1) && canConcatEqStr(t, arg1, prefixStr) == 0)
+        || (isConcatFunc(t, arg2) && canConcatEqStr(t, arg2, suffixStr) == 0)) {
+      and_items[and_count++] = Z3_mk_not(ctx, lenEq);
+      continue;
+    }
+
+    Z3_ast prefixAst = my_mk_str_value(t, prefixStr.c_str());
+    Z3_ast suffixAst = my_mk_str_value(t, suffixStr.c_str());
+    Z3_ast eqs[2] = { Z3_mk_eq(ctx, arg1, prefixAst), Z3_mk_eq(ctx, arg2, suffixAst) };
+    and_items[and_count++] = Z3_mk_implies(ctx, lenEq, Z3_mk_and(ctx, 2, eqs));
+    strEqLengthAxiom(t, arg1, prefixAst, __LINE__);
+    strEqLengthAxiom(t, arg2, suffixAst, __LINE__);
+  }
+
+  Z3_ast implyL = Z3_mk_eq(ctx, concatAst, constStr);
+  addAxiom(t, Z3_mk_implies(ctx, implyL, Z3_mk_and(ctx, and_count, and_items)), __LINE__);
+  delete[] and_items;
+}
+
+/*
+ * OWN CODE
+ * Few split points survive canConcatEqStr: assert them all at once, with
+ * Length(arg1) restricted to them
+ */
+void genConcatSplitPoints(Z3_theory t, Z3_ast concatAst, Z3_ast constStr, Z3_ast arg1, Z3_ast arg2, const std::vector<int> & points) {
+  Z3_context ctx = Z3_theory_get_context(t);
+  std::string const_str = getConstStrValue(t, constStr);
+  int concatStrLen = const_str.length();
+  Z3_ast implyL = Z3_mk_eq(ctx, concatAst, constStr);
+  if (points.empty()) {
+    addAxiom(t, Z3_mk_not(ctx, implyL), __LINE__);
+    return;
+  }
+
+  Z3_ast arg1Len = mk_length(t, arg1);
+  int count = points.size();
+  Z3_ast * or_items = new Z3_ast[count];
+  Z3_ast * and_items = new Z3_ast[count + 1];
+  for (int k = 0; k < count; k++) {
+    int i = points[k];
+    Z3_ast prefixAst = my_mk_str_value(t, const_str.substr(0, i).c_str());
+    Z3_ast suffixAst = my_mk_str_value(t, const_str.substr(i, concatStrLen - i).c_str());
+    Z3_ast eqs[2] = { Z3_mk_eq(ctx, arg1, prefixAst), Z3_mk_eq(ctx, arg2, suffixAst) };
+    or_items[k] = Z3_mk_eq(ctx, arg1Len, mk_int(ctx, i));
+    and_items[k + 1] = Z3_mk_implies(ctx, or_items[k], Z3_mk_and(ctx, 2, eqs));
+    strEqLengthAxiom(t, arg1, prefixAst, __LINE__);
+    strEqLengthAxiom(t, arg2, suffixAst, __LINE__);
+  }
+  and_items[0] = (count == 1) ? or_items[0] : Z3_mk_or(ctx, count, or_items);
+  addArrangementAxiom(t, concatAst, constStr, Z3_mk_implies(ctx, implyL, Z3_mk_and(ctx, count + 1, and_items)), __LINE__);
+  delete[] or_items;
+  delete[] and_items;
+}
+
+/*
+ * OWN CODE
+ * (Concat arg1 arg2) = "constant" where the leaf of arg1 or arg2 next to the
+ * split point is under a Matches atom: keep only the split points where the
+ * regex can match the constant there, as a disjunction over Length(arg1).
+ * Saves trying every prefix when the regex fixes where the cut must be.
+ */
+void addRegexSplitAxiom(Z3_theory t, Z3_ast concatAst, Z3_ast constStr, Z3_ast arg1, Z3_ast arg2) {
+  Z3_context ctx = Z3_theory_get_context(t);
+  std::string const_str = getConstStrValue(t, constStr);
+  int concatStrLen = const_str.length();
+  std::vector<bool> feasible(concatStrLen + 1, true);
+  std::vector<Z3_ast> premise;
+  for (int side = 0; side < 2; side++) {
+    Z3_ast arg = (side == 0) ? arg1 : arg2;
+    Z3_ast leaf = (side == 0) ? getMostRightNodeInConcat(t, arg1) : getMostLeftNodeInConcat(t, arg2);
+    std::map<Z3_ast, std::vector<std::pair<std::string, Z3_ast> > >::iterator it = matchesAtomMap.find(leaf);
+    if (it == matchesAtomMap.end())
+      continue;
+    for (unsigned int k = 0; k < it->second.size(); k++) {
+      T_regexMatchIndex * index = getRegexMatchIndex(it->second[k].first, const_str);
+      if (index == NULL)
+        continue;
+      // ok[i]: the leaf can end (side 0) / start (side 1) at i
+      std::vector<bool> ok(concatStrLen + 1, false);
+      for (int i = 0; i <= concatStrLen; i++) {
+        if (side == 0 && leaf == arg && i > 0)
+          break;
+        const std::vector<int> & ends = regexMatchEnds(index, i);
+        if (side == 1) {
+          ok[i] = (leaf == arg) ? std::binary_search(ends.begin(), ends.end(), concatStrLen) : ! ends.empty();
+        } else {
+          for (unsigned int e = 0; e < ends.size(); e++)
+            ok[ends[e]] = true;
+        }
+      }
+      bool cuts = false;
+      for (int i = 0; i <= concatStrLen; i++) {
+        if (feasible[i] && ! ok[i]) {
+          feasible[i] = false;
+          cuts = true;
+        }
+      }
+      if (cuts)
+        premise.push_back(it->second[k].second);
+    }
+  }
+  if (premise.empty())
+    return;
+
+  premise.push_back(Z3_mk_eq(ctx, concatAst, constStr));
+  Z3_ast premiseAst = Z3_mk_and(ctx, premise.size(), &premise[0]);
+  Z3_ast arg1Len = mk_length(t, arg1);
+  std::vector<Z3_ast> options;
+  for (int i = 0; i <= concatStrLen; i++) {
+    if (feasible[i])
+      options.push_back(Z3_mk_eq(ctx, arg1Len, mk_int(ctx, i)));
+  }
+  if (options.empty()) {
+    addAxiom(t, Z3_mk_not(ctx, premiseAst), __LINE__);
+  } else {
+    Z3_ast optionAst = (options.size() == 1) ? options[0] : Z3_mk_or(ctx, options.size(), &options[0]);
+    addAxiom(t, Z3_mk_implies(ctx, premiseAst, optionAst), __LINE__);
+  }
+}
+
+/*
+ * OWN CODE
+ * Extend the lazily split (Concat x y) = "constant" equalities that still hold but
+ * whose x has not been pinned to a prefix yet: the solver picked a Length(x) beyond
+ * the split points materialised so far. Windows double in size, so a constant of
+ * length n is covered after O(log n) rounds at worst.
+ */
+bool genPendingConcatSplits(Z3_theory t) {
+  bool added = false;
+  std::map<std::pair<Z3_ast, Z3_ast>, T_concatSplit>::iterator itor = pendingConcatSplit.begin();
+  for (; itor != pendingConcatSplit.end(); itor++) {
+    Z3_ast concatAst = itor->first.first;
+    Z3_ast constStr = itor->first.second;
+    T_concatSplit & split = itor->second;
+    int concatStrLen = eqcConstLength(t, constStr);
+    int next = split.windows.empty() ? 0 : split.windows.back().second;
+    if (next > concatStrLen)
+      continue;
+    if (get_eqc_value(t, concatAst) != constStr)
+      continue;
+    if (get_eqc_value(t, split.arg1) != split.arg1)
+      continue;
+
+    int to = next + (next > lazySplitWindow ? next : lazySplitWindow);
+    if (to < split.reached)
+      to = split.reached;
+    genConcatSplitWindow(t, concatAst, constStr, split.arg1, split.arg2, next, to);
+    split.windows.push_back(std::make_pair(sLevel, to));
+    split.reached = to;
+    added = true;
+  }
+  return added;
+}
+
 void solve_concat_eq_str(Z3_theory t, Z3_ast concatAst, Z3_ast constStr) {
 #ifdef DEBUGLOG
   __debugPrint(logFile, "** solve_concat_eq_str: ");
@@ -2030,7 +2621,37 @@ void solve_concat_eq_str(Z3_theory t, Z3_ast concatAst, Z3_ast constStr) {
     //     Only when arg1 and arg2 do not have eq constant string values
     //---------------------------------------------------------------------
     else {
-      if (Concat(t, arg1, arg2) == NULL) {
+      addRegexSplitAxiom(t, concatAst, constStr, arg1, arg2);
+      // only reached from new_eq, never from final check
+      if (arrangementLive(concatAst, constStr)) {
+        __debugPrint(logFile, ">> Split of this Concat = const_str still asserted @ %d\n", __LINE__);
+      } else if (Concat(t, arg1, arg2) == NULL && (int) const_str.length() > lazySplitMinLength) {
+        // long constant: when canConcatEqStr leaves only a few split points, all of them,
+        // otherwise only the first split points now, the rest on demand in cb_final_check
+        bool canPrune = isConcatFunc(t, arg1) || isConcatFunc(t, arg2);
+        std::vector<int> points;
+        if (canPrune) {
+          int concatStrLen = const_str.length();
+          for (int i = 0; i <= concatStrLen && (int) points.size() <= lazySplitWindow; i++) {
+            if (isConcatFunc(t, arg1) && canConcatEqStr(t, arg1, const_str, 0, i) == 0)
+              continue;
+            if (isConcatFunc(t, arg2) && canConcatEqStr(t, arg2, const_str, i, concatStrLen - i) == 0)
+              continue;
+            points.push_back(i);
+          }
+        }
+        if (canPrune && (int) points.size() <= lazySplitWindow) {
+          genConcatSplitPoints(t, concatAst, constStr, arg1, arg2, points);
+        } else if (pendingConcatSplit[std::make_pair(concatAst, constStr)].windows.empty()) {
+          T_concatSplit & split = pendingConcatSplit[std::make_pair(concatAst, constStr)];
+          int to = std::max(split.reached, lazySplitWindow);
+          split.arg1 = arg1;
+          split.arg2 = arg2;
+          genConcatSplitWindow(t, concatAst, constStr, arg1, arg2, 0, to);
+          split.windows.push_back(std::make_pair(sLevel, to));
+          split.reached = to;
+        }
+      } else if (Concat(t, arg1, arg2) == NULL) {
         Z3_ast xorFlag = NULL;
         std::pair<Z3_ast, Z3_ast> key1(arg1, arg2);
         std::pair<Z3_ast, Z3_ast> key2(arg2, arg1);
@@ -2093,7 +2714,7 @@ void solve_concat_eq_str(Z3_theory t, Z3_ast concatAst, Z3_ast constStr) {
             implyR1 = Z3_mk_and(ctx, and_count, and_items);
           }
           Z3_ast implyToAssert = Z3_mk_implies(ctx, implyL, implyR1);
-          addAxiom(t, implyToAssert, __LINE__);
+          addArrangementAxiom(t, concatAst, constStr, implyToAssert, __LINE__);
         }
         delete[] xor_items;
         delete[] and_items;
@@ -2379,6 +3000,158 @@ void simplifyStarEq(Z3_theory t, Z3_ast nn1, Z3_ast nn2, int duplicateCheck) {
   }
 }
 
+/*
+ * OWN CODE
+ * Tokens of the leaves of a Concat (constants expanded to characters) for the
+ * Nielsen engine. Returns the number of characters added. Each leaf replaced
+ * by its eqc value adds "leaf = value" to premises.
+ */
+#define maxNielsenConstChars 64
+
+int nielsenAddLeaves(Z3_theory t, Z3_ast node, T_wordSide & side, std::map<Z3_ast, int> & varId, std::vector<Z3_ast> & vars,
+    std::vector<Z3_ast> & premises) {
+  Z3_context ctx = Z3_theory_get_context(t);
+  std::vector<Z3_ast> leaf(1, node);
+  const std::vector<Z3_ast> & leaves = isConcatFunc(t, node) ? getConcatSeqLeaves(t, node) : leaf;
+  int chars = 0;
+  for (unsigned int i = 0; i < leaves.size(); i++) {
+    Z3_ast leaf = get_eqc_value(t, leaves[i]);
+    if (leaf != leaves[i]) {
+      Z3_ast premise = Z3_mk_eq(ctx, leaves[i], leaf);
+      if (std::find(premises.begin(), premises.end(), premise) == premises.end())
+        premises.push_back(premise);
+    }
+    if (isConstStr(t, leaf)) {
+      std::string str = getConstStrValue(t, leaf);
+      for (unsigned int k = 0; k < str.length(); k++)
+        side.push_back(-((int) (unsigned char) str[k]) - 1);
+      chars += str.length();
+    } else {
+      if (varId.find(leaf) == varId.end()) {
+        varId[leaf] = vars.size();
+        vars.push_back(leaf);
+      }
+      side.push_back(varId[leaf]);
+    }
+  }
+  return chars;
+}
+
+Z3_ast nielsenSideToAst(Z3_theory t, const T_wordSide & side, const std::vector<Z3_ast> & vars) {
+  Z3_ast result = NULL;
+  std::string constRun;
+  for (unsigned int i = 0; i <= side.size(); i++) {
+    if (i < side.size() && side[i] < 0) {
+      constRun += (char) (-side[i] - 1);
+      continue;
+    }
+    Z3_ast item = NULL;
+    if (constRun != "") {
+      item = my_mk_str_value(t, constRun.c_str());
+      result = (result == NULL) ? item : mk_concat(t, result, item);
+      constRun = "";
+    }
+    if (i < side.size()) {
+      item = vars[side[i]];
+      result = (result == NULL) ? item : mk_concat(t, result, item);
+    }
+  }
+  if (result == NULL)
+    result = my_mk_str_value(t, "");
+  return result;
+}
+
+/*
+ * OWN CODE
+ * Word-equation engine for nn1 = nn2 (both Concat), used with --nielsen
+ * instead of the arrangement splits below whenever it can decide the next step:
+ *   - prefix/suffix cancellation, length and letter-count conflicts
+ *   - a side reduced to nothing or to a single variable
+ *   - x = "" when that is the only first Nielsen move with a reachable solution
+ * Returns false to fall back to the arrangements.
+ */
+bool nielsenConcatEq(Z3_theory t, Z3_ast nn1, Z3_ast nn2) {
+  Z3_context ctx = Z3_theory_get_context(t);
+  std::map<Z3_ast, int> varId;
+  std::vector<Z3_ast> vars;
+  T_wordSide lhs;
+  T_wordSide rhs;
+  std::vector<Z3_ast> premises;
+  int chars = nielsenAddLeaves(t, nn1, lhs, varId, vars, premises);
+  chars += nielsenAddLeaves(t, nn2, rhs, varId, vars, premises);
+  if (chars > maxNielsenConstChars)
+    return false;
+
+  // the leaf values used above hold only under premises
+  premises.push_back(Z3_mk_eq(ctx, nn1, nn2));
+  Z3_ast implyL = my_mk_and(t, &premises[0], premises.size());
+  T_wordSide l = lhs;
+  T_wordSide r = rhs;
+  int res = nielsenSimplify(l, r);
+  if (res == -1) {
+    __debugPrint(logFile, ">> [nielsen] conflict @ %d\n", __LINE__);
+    addAxiom(t, Z3_mk_not(ctx, implyL), __LINE__);
+    return true;
+  }
+  if (res == 0) {
+    __debugPrint(logFile, ">> [nielsen] trivial @ %d\n", __LINE__);
+    return true;
+  }
+
+  if (nielsenSolvedByEmpty(l, r)) {
+    const T_wordSide & other = l.empty() ? r : l;
+    Z3_ast * items = new Z3_ast[other.size()];
+    for (unsigned int i = 0; i < other.size(); i++)
+      items[i] = Z3_mk_eq(ctx, vars[other[i]], my_mk_str_value(t, ""));
+    addAxiom(t, Z3_mk_implies(ctx, implyL, my_mk_and(t, items, other.size())), __LINE__);
+    delete[] items;
+    return true;
+  }
+
+  if (l != lhs || r != rhs || l.size() == 1 || r.size() == 1) {
+    // what is left after cancellation, handled again once it reaches an eqc
+    Z3_ast newL = nielsenSideToAst(t, l, vars);
+    Z3_ast newR = nielsenSideToAst(t, r, vars);
+    if (newL != nn1 || newR != nn2)
+      addAxiom(t, Z3_mk_implies(ctx, implyL, Z3_mk_eq(ctx, newL, newR)), __LINE__);
+    return false;
+  }
+
+  std::vector<T_nielsenMove> moves;
+  nielsenBranches(l, r, moves);
+  int feasible = -1;
+  int feasibleCount = 0;
+  for (unsigned int i = 0; i < moves.size(); i++) {
+    T_wordSide newL;
+    T_wordSide newR;
+    nielsenApply(l, r, moves[i], newL, newR);
+    if (nielsenSearch(newL, newR) != 0) {
+      feasible = i;
+      feasibleCount++;
+    }
+  }
+  __debugPrint(logFile, ">> [nielsen] %d of %d moves feasible @ %d\n", feasibleCount, (int) moves.size(), __LINE__);
+
+  if (feasibleCount == 0) {
+    addAxiom(t, Z3_mk_not(ctx, implyL), __LINE__);
+    return true;
+  }
+  // x = prefix x' would need a fresh variable each time, which the arrangements
+  // already bound with their loop checks: only x = "" is taken here
+  if (feasibleCount > 1 || !moves[feasible].toEmpty)
+    return false;
+
+  T_wordSide newL;
+  T_wordSide newR;
+  nielsenApply(l, r, moves[feasible], newL, newR);
+  nielsenSimplify(newL, newR);
+  Z3_ast and_items[2];
+  and_items[0] = Z3_mk_eq(ctx, vars[moves[feasible].var], my_mk_str_value(t, ""));
+  and_items[1] = Z3_mk_eq(ctx, nielsenSideToAst(t, newL, vars), nielsenSideToAst(t, newR, vars));
+  addAxiom(t, Z3_mk_implies(ctx, implyL, Z3_mk_and(ctx, 2, and_items)), __LINE__);
+  return true;
+}
+
 /*
  * Handle two equivalent Concats. nn1 and nn2 are two concat functions
  */
@@ -2466,6 +3239,11 @@ void simplifyConcatEq(Z3_theory t, Z3_ast nn1, Z3_ast nn2, int duplicateCheck) {
     return;
   }
 
+  if (sameConcatSeq(t, new_nn1, new_nn2)) {
+    __debugPrint(logFile, ">> Same flattened sequence, return.\n");
+    return;
+  }
+
   if (!canTwoNodesEq(t, new_nn1, new_nn2)) {
     Z3_ast detected = Z3_mk_not(ctx, Z3_mk_eq(ctx, new_nn1, new_nn2));
     __debugPrint(logFile, "\n");
@@ -2521,6 +3299,11 @@ void simplifyConcatEq(Z3_theory t, Z3_ast nn1, Z3_ast nn2, int duplicateCheck) {
     }
   }
 
+  // final check (duplicateCheck == 0) wants a split, the arrangements below make one
+  if (useNielsen && duplicateCheck && nielsenConcatEq(t, new_nn1, new_nn2)) {
+    return;
+  }
+
   int duplicatedSplit = 0;
   if (duplicateCheck) {
     if (isConcatFunc(t, new_nn1) && isConcatFunc(t, new_nn2)) {
@@ -2530,6 +3313,10 @@ void simplifyConcatEq(Z3_theory t, Z3_ast nn1, Z3_ast nn2, int duplicateCheck) {
         std::pair<Z3_ast, Z3_ast> key2(new_nn2, new_nn1);
         {
           duplicatedSplit = 1;
+          // OWN CODE: this pair was split before and the split is popped
+          if ((varForBreakConcat.find(v) != varForBreakConcat.end() || varForBreakConcat.find(key2) != varForBreakConcat.end())
+              && !arrangementLive(new_nn1, new_nn2))
+            arrangementPending.insert(v);
         }
 
       } else if (concat_eqc_index.find(new_nn1) == concat_eqc_index.end() && concat_eqc_index.find(new_nn2) != concat_eqc_index.end()) {
@@ -2612,6 +3399,12 @@ void simplifyConcatEq(Z3_theory t, Z3_ast nn1, Z3_ast nn2, int duplicateCheck) {
   // Start to split two Concats
   //*****************************************************
 
+  // final check (duplicateCheck == 0) rebuilds the split even while it is asserted
+  if (duplicateCheck != 0 && arrangementLive(new_nn1, new_nn2)) {
+    __debugPrint(logFile, ">> Split of these Concats still asserted @ %d\n\n", __LINE__);
+    return;
+  }
+
   checkandInit_cutVAR(t, v1_arg0);
   checkandInit_cutVAR(t, v1_arg1);
   checkandInit_cutVAR(t, v2_arg0);
@@ -2781,7 +3574,7 @@ void simplifyConcatEq(Z3_theory t, Z3_ast nn1, Z3_ast nn2, int duplicateCheck) {
           Z3_ast implyR = Z3_mk_and(ctx, pos, and_item);
           Z3_ast toAssert = Z3_mk_implies(ctx, implyL, implyR);
 
-          addAxiom(t, toAssert, __LINE__);
+          addArrangementAxiom(t, new_nn1, new_nn2, toAssert, __LINE__);
         } else {
           __debugPrint(logFile, "\n[STOP @ %d] Should not split two EQ concats:", __LINE__);
           __debugPrint(logFile, "\n            ");
@@ -2918,7 +3711,7 @@ void simplifyConcatEq(Z3_theory t, Z3_ast nn1, Z3_ast nn2, int duplicateCheck) {
           else
             and_item[0] = Z3_mk_or(ctx, option, or_item);
           Z3_ast implyR = Z3_mk_and(ctx, pos, and_item);
-          addAxiom(t, Z3_mk_implies(ctx, implyL, implyR), __LINE__);
+          addArrangementAxiom(t, new_nn1, new_nn2, Z3_mk_implies(ctx, implyL, implyR), __LINE__);
         } else {
           __debugPrint(logFile, "\n[STOP @ %d] Should not split two EQ concats:", __LINE__);
           __debugPrint(logFile, "\n            ");
@@ -3055,7 +3848,7 @@ void simplifyConcatEq(Z3_theory t, Z3_ast nn1, Z3_ast nn2, int duplicateCheck) {
           else
             and_item[0] = Z3_mk_or(ctx, option, or_item);
           Z3_ast implyR = Z3_mk_and(ctx, pos, and_item);
-          addAxiom(t, Z3_mk_implies(ctx, implyL, implyR), __LINE__);
+          addArrangementAxiom(t, new_nn1, new_nn2, Z3_mk_implies(ctx, implyL, implyR), __LINE__);
         } else {
           __debugPrint(logFile, "\n[STOP @ %d] Should not split two EQ concats:", __LINE__);
           __debugPrint(logFile, "\n            ");
@@ -3311,7 +4104,7 @@ void simplifyConcatEq(Z3_theory t, Z3_ast nn1, Z3_ast nn2, int duplicateCheck) {
 
       and_item[0] = Z3_mk_or(ctx, option, or_item);
       Z3_ast implyR = Z3_mk_and(ctx, pos, and_item);
-      addAxiom(t, Z3_mk_implies(ctx, implyL, implyR), __LINE__);
+      addArrangementAxiom(t, new_nn1, new_nn2, Z3_mk_implies(ctx, implyL, implyR), __LINE__);
       delete or_item;
       delete and_item;
       return;
@@ -3473,7 +4266,7 @@ void simplifyStarEqConcat(Z3_theory t, Z3_ast starAst, Z3_ast concatAst, int dup
         dp[id_dp] = new int [length_concat_arg1];
       }
 
-      getStarableFromEnd(dp, getRegexValue(t, star_arg0), const_concat_arg1);
+      getStarableFromEnd(dp, getRegexString(t, star_arg0), const_concat_arg1);
       
       Z3_ast * or_cases = new Z3_ast[length_concat_arg1 + 1];
       int pos = 0;
@@ -3573,7 +4366,7 @@ void simplifyStarEqConcat(Z3_theory t, Z3_ast starAst, Z3_ast concatAst, int dup
         dp[id_dp] = new int [length_concat_arg0];
       }
 
-      getStarableFromStart(dp, getRegexValue(t, star_arg0), const_concat_arg0);
+      getStarableFromStart(dp, getRegexString(t, star_arg0), const_concat_arg0);
       
       Z3_ast * or_cases = new Z3_ast[length_concat_arg0 + 1];
       int pos = 0;
@@ -3712,6 +4505,36 @@ void printContext(Z3_theory t) {
 #endif
 }
 
+/*
+ * OWN CODE
+ * Concat = Concat and Concat = constant are analysed once per scope for each
+ * pair of flattened sequences: every Concat stands for the first Concat built
+ * with its seqId (all of them are already put in one eqc by mk_concat), and
+ * the pair is unordered. Returns true if this one already was.
+ */
+bool concatEqAnalysed(Z3_theory t, Z3_ast v1, Z3_ast v2) {
+  bool v1IsConcat = isConcatFunc(t, v1);
+  bool v2IsConcat = isConcatFunc(t, v2);
+  if (!(v1IsConcat && (v2IsConcat || isConstStr(t, v2))) && !(v2IsConcat && isConstStr(t, v1)))
+    return false;
+
+  Z3_ast rep1 = v1IsConcat ? concatSeqRep[getConcatView(t, v1)->seqId] : v1;
+  Z3_ast rep2 = v2IsConcat ? concatSeqRep[getConcatView(t, v2)->seqId] : v2;
+  std::pair<Z3_ast, Z3_ast> key = rep1 < rep2 ? std::make_pair(rep1, rep2) : std::make_pair(rep2, rep1);
+  if (concatEqPairLevel.find(key) != concatEqPairLevel.end()) {
+#ifdef DEBUGLOG
+    __debugPrint(logFile, ">> [concatEqAnalysed] skip ");
+    printZ3Node(t, v1);
+    __debugPrint(logFile, " = ");
+    printZ3Node(t, v2);
+    __debugPrint(logFile, "\n");
+#endif
+    return true;
+  }
+  concatEqPairLevel[key] = sLevel;
+  return false;
+}
+
 /*
  * Process two nodes that are assumed to be equal by Z3
  */
@@ -3879,7 +4702,7 @@ void moreValueTests(Z3_theory t, Z3_ast valTester, std::string valTesterValue) {
 /*
  *
  */
-void cb_new_eq(Z3_theory t, Z3_ast nn1, Z3_ast nn2) {
+void strNewEq(Z3_theory t, Z3_ast nn1, Z3_ast nn2) {
 #ifdef DEBUGLOG
 
     print_All_Eqc(t);
@@ -3937,6 +4760,13 @@ void cb_new_eq(Z3_theory t, Z3_ast nn1, Z3_ast nn2) {
     }
   }
 
+  if (! matchesAtomMap.empty()) {
+    matchesEqcCheck(t, nn1, nn2);
+  }
+  if (! regexAtomVarMap.empty()) {
+    regexAtomCheck(t, nn1, nn2);
+  }
+
   // should do the consistent check first
   if (newEqCheck(t, nn1, nn2) == -1) {
     return;
@@ -3954,7 +4784,8 @@ void cb_new_eq(Z3_theory t, Z3_ast nn1, Z3_ast nn2) {
   do {
     eqc_nn2 = nn2;
     do {
-      handleNodesEqual(t, eqc_nn1, eqc_nn2);
+      if (eqc_nn1 != eqc_nn2 && !concatEqAnalysed(t, eqc_nn1, eqc_nn2))
+        handleNodesEqual(t, eqc_nn1, eqc_nn2);
       eqc_nn2 = Z3_theory_get_eqc_next(t, eqc_nn2);
     } while (eqc_nn2 != nn2);
     eqc_nn1 = Z3_theory_get_eqc_next(t, eqc_nn1);
@@ -3979,6 +4810,14 @@ void cb_new_eq(Z3_theory t, Z3_ast nn1, Z3_ast nn2) {
   }
 }
 
+/*
+ *
+ */
+void cb_new_eq(Z3_theory t, Z3_ast nn1, Z3_ast nn2) {
+  strNewEq(t, nn1, nn2);
+  mergeEqcInfo(t, nn1, nn2);
+}
+
 /*
  * Add axioms that are true for any string var
  */
@@ -4136,10 +4975,137 @@ inline Z3_ast getAliasIndexAst(std::map<Z3_ast, Z3_ast> & aliasIndexMap, Z3_ast
  *
  */
 
+/*
+ * OWN CODE
+ * Value and KMP failure table of an interned string constant, computed once
+ */
+const T_constIndex * getConstIndex(Z3_theory t, Z3_ast constAst) {
+  std::map<Z3_ast, T_constIndex *>::iterator itor = constIndexMap.find(constAst);
+  if (itor != constIndexMap.end())
+    return itor->second;
+
+  T_constIndex * index = new T_constIndex();
+  index->value = getConstStrValue(t, constAst);
+  int len = index->value.length();
+  index->fail.resize(len + 1);
+  index->fail[0] = -1;
+  int k = -1;
+  for (int i = 0; i < len; i++) {
+    while (k >= 0 && index->value[k] != index->value[i])
+      k = index->fail[k];
+    k++;
+    index->fail[i + 1] = k;
+  }
+  constIndexMap[constAst] = index;
+  return index;
+}
+
+/*
+ * OWN CODE
+ * First position p in [from, to - |pattern|] with text[p, p + |pattern|) == pattern, or -1
+ */
+int constIndexFind(const T_constIndex * pattern, const std::string & text, int from, int to) {
+  int len = pattern->value.length();
+  if (len == 0)
+    return from <= to ? from : -1;
+  int k = 0;
+  for (int i = from; i < to; i++) {
+    while (k >= 0 && pattern->value[k] != text[i])
+      k = pattern->fail[k];
+    k++;
+    if (k == len)
+      return i - len + 1;
+  }
+  return -1;
+}
+
+/*
+ * OWN CODE
+ * Build (or fetch) the flattened view of a Concat node from the views of its
+ * two arguments, so each Concat is walked once no matter how often it is queried.
+ */
+const T_concatView * getConcatView(Z3_theory t, Z3_ast node) {
+  std::map<Z3_ast, T_concatView *>::iterator itor = concatViewMap.find(node);
+  if (itor != concatViewMap.end())
+    return itor->second;
+
+  Z3_context ctx = Z3_theory_get_context(t);
+  T_concatView * view = new T_concatView();
+  view->constLength = 0;
+  // canonical key: runs of constants merged into one constant, empty ones dropped.
+  // The keys of the arguments already are, only their boundary can merge.
+  std::vector<Z3_ast> key;
+  for (int i = 0; i < 2; i++) {
+    Z3_ast arg = Z3_get_app_arg(ctx, Z3_to_app(ctx, node), i);
+    std::vector<Z3_ast> argLeaf(1, arg);
+    const std::vector<Z3_ast> * argLeaves = &argLeaf;
+    Z3_ast argLeft = arg;
+    Z3_ast argRight = arg;
+    if (isConcatFunc(t, arg)) {
+      const T_concatView * argView = getConcatView(t, arg);
+      argLeaves = concatSeqLeaves[argView->seqId];
+      argLeft = argView->mostLeft;
+      argRight = argView->mostRight;
+      view->constLength += argView->constLength;
+    } else if (isConstStr(t, arg)) {
+      view->constLength += getConstStrValue(t, arg).length();
+    }
+    if (i == 0)
+      view->mostLeft = argLeft;
+    else
+      view->mostRight = argRight;
+    for (unsigned int k = 0; k < argLeaves->size(); k++) {
+      Z3_ast leaf = (*argLeaves)[k];
+      if (isConstStr(t, leaf)) {
+        std::string value = getConstStrValue(t, leaf);
+        if (value == "")
+          continue;
+        if (!key.empty() && isConstStr(t, key.back())) {
+          key.back() = my_mk_str_value(t, (getConstStrValue(t, key.back()) + value).c_str());
+          continue;
+        }
+      }
+      key.push_back(leaf);
+    }
+  }
+  for (unsigned int i = 0; i < key.size(); i++) {
+    if (isConstStr(t, key[i]))
+      view->constPieces.push_back(getConstIndex(t, key[i]));
+  }
+  view->constFirst = !key.empty() && isConstStr(t, key.front());
+  view->constLast = !key.empty() && isConstStr(t, key.back());
+  std::map<std::vector<Z3_ast>, int>::iterator seqItor = concatSeqIdMap.find(key);
+  if (seqItor == concatSeqIdMap.end()) {
+    view->seqId = concatSeqRep.size();
+    seqItor = concatSeqIdMap.insert(std::make_pair(key, view->seqId)).first;
+    concatSeqRep.push_back(node);
+    concatSeqLeaves.push_back(&seqItor->first);
+  } else {
+    view->seqId = seqItor->second;
+  }
+
+  concatViewMap[node] = view;
+  return view;
+}
+
+/*
+ * OWN CODE
+ * Two Concat nodes spelling the same sequence (up to associativity) are equal
+ */
+bool sameConcatSeq(Z3_theory t, Z3_ast n1, Z3_ast n2) {
+  if (n1 == n2)
+    return true;
+  if (!isConcatFunc(t, n1) || !isConcatFunc(t, n2))
+    return false;
+  return getConcatView(t, n1)->seqId == getConcatView(t, n2)->seqId;
+}
+
+/*
+ *
+ */
 void getNodesInConcat(Z3_theory t, Z3_ast node, std::vector<Z3_ast> & nodeList) {
-  PATheoryData * td = (PATheoryData*) Z3_theory_get_ext_data(t);
   Z3_context ctx = Z3_theory_get_context(t);
-  if (getNodeType(t, node) != my_Z3_Func || (getNodeType(t, node) == my_Z3_Func && Z3_get_app_decl(ctx, Z3_to_app(ctx, node)) != td->Concat)) {
+  if (getNodeType(t, node) != my_Z3_Func || !isConcatFunc(t, node)) {
     nodeList.push_back(node);
     return;
   } else {
@@ -4150,31 +5116,29 @@ void getNodesInConcat(Z3_theory t, Z3_ast node, std::vector<Z3_ast> & nodeList)
   }
 }
 
+/*
+ * OWN CODE
+ * Leaves of a Concat as its seqId spells them, shared by every Concat with it
+ */
+const std::vector<Z3_ast> & getConcatSeqLeaves(Z3_theory t, Z3_ast node) {
+  return *concatSeqLeaves[getConcatView(t, node)->seqId];
+}
+
 Z3_ast getMostLeftNodeInConcat(Z3_theory t, Z3_ast node) {
-  PATheoryData * td = (PATheoryData*) Z3_theory_get_ext_data(t);
-  Z3_context ctx = Z3_theory_get_context(t);
-
-  if (getNodeType(t, node) != my_Z3_Func || (getNodeType(t, node) == my_Z3_Func && Z3_get_app_decl(ctx, Z3_to_app(ctx, node)) != td->Concat))
+  if (getNodeType(t, node) != my_Z3_Func || !isConcatFunc(t, node))
     return node;
-  else {
-    Z3_ast concatArgL = Z3_get_app_arg(ctx, Z3_to_app(ctx, node), 0);
-    return getMostLeftNodeInConcat(t, concatArgL);
-  }
+  else
+    return getConcatView(t, node)->mostLeft;
 }
 
 /*
  *
  */
 Z3_ast getMostRightNodeInConcat(Z3_theory t, Z3_ast node) {
-  PATheoryData * td = (PATheoryData*) Z3_theory_get_ext_data(t);
-  Z3_context ctx = Z3_theory_get_context(t);
-
-  if (getNodeType(t, node) != my_Z3_Func || (getNodeType(t, node) == my_Z3_Func && Z3_get_app_decl(ctx, Z3_to_app(ctx, node)) != td->Concat))
+  if (getNodeType(t, node) != my_Z3_Func || !isConcatFunc(t, node))
     return node;
-  else {
-    Z3_ast concatArgR = Z3_get_app_arg(ctx, Z3_to_app(ctx, node), 1);
-    return getMostRightNodeInConcat(t, concatArgR);
-  }
+  else
+    return getConcatView(t, node)->mostRight;
 }
 
 /*
@@ -4457,12 +5421,8 @@ int ctxDepAnalysis(Z3_theory t, std::map<Z3_ast, int> & strVarMap,
         if (isConcatFunc(t, curr)) {
           Z3_ast arg0 = Z3_get_app_arg(ctx, Z3_to_app(ctx, curr), 0);
           Z3_ast arg1 = Z3_get_app_arg(ctx, Z3_to_app(ctx, curr), 1);
-          Z3_ast arg0_value = get_eqc_value(t, arg0);
-          Z3_ast arg1_value = get_eqc_value(t, arg1);
-          T_myZ3Type arg0_vType = getNodeType(t, arg0_value);
-          T_myZ3Type arg1_vType = getNodeType(t, arg1_value);
-          bool is_arg0_emptyStr = (arg0_vType == my_Z3_ConstStr) && (getConstStrValue(t, arg0_value) == "");
-          bool is_arg1_emptyStr = (arg1_vType == my_Z3_ConstStr) && (getConstStrValue(t, arg1_value) == "");
+          bool is_arg0_emptyStr = eqcIsEmptyStr(t, arg0);
+          bool is_arg1_emptyStr = eqcIsEmptyStr(t, arg1);
           if (!is_arg0_emptyStr && !is_arg1_emptyStr) {
             var_eq_concat_map[deAliasNode][curr] = 1;
           }
@@ -4479,12 +5439,8 @@ int ctxDepAnalysis(Z3_theory t, std::map<Z3_ast, int> & strVarMap,
         if (isStarFunc(t, curr)) {
           Z3_ast arg0 = Z3_get_app_arg(ctx, Z3_to_app(ctx, curr), 0);
           Z3_ast arg1 = Z3_get_app_arg(ctx, Z3_to_app(ctx, curr), 1);
-          Z3_ast arg0_value = get_eqc_value(t, arg0);
-          Z3_ast arg1_value = get_eqc_value(t, arg1);
-          T_myZ3Type arg0_vType = getNodeType(t, arg0_value);
-          T_myZ3Type arg1_vType = getNodeType(t, arg1_value);
-          bool is_arg0_emptyStr = (arg0_vType == my_Z3_ConstStr) && (getConstStrValue(t, arg0_value) == "");
-          bool is_arg1_emptyStr = (arg1_vType == my_Z3_ConstStr) && (getConstStrValue(t, arg1_value) == "");
+          bool is_arg0_emptyStr = eqcIsEmptyStr(t, arg0);
+          bool is_arg1_emptyStr = eqcIsEmptyStr(t, arg1);
           if (!is_arg0_emptyStr && !is_arg1_emptyStr) {
             var_eq_star_map[deAliasNode][curr] = 1;
           }
@@ -5299,7 +6255,8 @@ Z3_ast genStarTestOptions(Z3_theory t, Z3_ast freeVar, int i){
 		Z3_ast starArgs[2];
 		starArgs[0] = Z3_get_app_arg(ctx, Z3_to_app(ctx, newStar), 0);
 		starArgs[1] = Z3_get_app_arg(ctx, Z3_to_app(ctx, newStar), 1);
-		Z3_ast result = reduce_star(t, starArgs, breakDownAst);
+		// unrolled for this star only, extending its unrolling for i - 1
+		Z3_ast result = mk_star(t, starArgs[0], starArgs[1], breakDownAst, star);
 		if (result != NULL){
 #ifdef DEBUGLOG
 			__debugPrint(logFile, "\n===================\n");
@@ -5920,7 +6877,11 @@ star_eq_star_map, star_eq_concat_map);
       __debugPrint(logFile, "\n");
 #endif
       // disable duplicate check when reducing eq concat
+      unsigned int arrangements = arrangementLevel.size();
       simplifyConcatEq(t, toBreak1, toBreak2, 0);
+      // OWN CODE: no new arrangement means the split is still asserted
+      if (arrangementLevel.size() == arrangements)
+        splitPendingArrangements(t);
     }
 #ifdef DEBUGLOG
     __debugPrint(logFile, "\n###########################################################\n\n");
@@ -5928,6 +6889,18 @@ star_eq_star_map, star_eq_concat_map);
     return Z3_TRUE;
   }
 
+  // long (Concat x y) = "constant" equalities whose split is not materialised yet
+  if (! pendingConcatSplit.empty() && genPendingConcatSplits(t)) {
+    __debugPrint(logFile, "\n###########################################################\n\n");
+    return Z3_TRUE;
+  }
+
+  // ReplaceAll results and arguments that disagree with their values
+  if (! replaceAllMap.empty() && genReplaceAllLemmas(t)) {
+    __debugPrint(logFile, "\n###########################################################\n\n");
+    return Z3_TRUE;
+  }
+
   //**************************************************************
   // Check whether variables appeared have eq string constants
   // If yes, all input variables are all assigned.
@@ -5941,8 +6914,7 @@ star_eq_star_map, star_eq_concat_map);
     if (vName.length() >= 3 && vName.substr(0, 3) == "_t_")
       continue;
 
-    Z3_ast vNode = get_eqc_value(t, itor->first);
-    if (itor->first == vNode){ 
+    if (!eqcHasConst(t, itor->first)) {
       needToAssignFreeVar = 1;
       break;
     }
@@ -5954,6 +6926,11 @@ star_eq_star_map, star_eq_concat_map);
     return Z3_TRUE;
   }
 
+  // strings under Matches first try values taken from the automata
+  if (! matchesAtomMap.empty() && genMatchesWitnessOptions(t)) {
+    return Z3_TRUE;
+  }
+
   // Assign free variables
 #ifdef DEBUGLOG
   {
@@ -6246,19 +7223,64 @@ void cb_init_search(Z3_theory t) {
 }
 
 /*
- *
+ * OWN CODE
+ * Cut s at offset: s = prefix . rest with Length(prefix) = offset. Cuts are
+ * shared by every Substring of s. A numeral offset past an earlier numeral cut
+ * p is taken from the rest of p, so prefixes at growing offsets extend one
+ * another instead of splitting s again. Cuts of constants at numerals fold.
  */
-Z3_ast reduce_subStr(Z3_theory t, Z3_ast const args[], Z3_ast & breakdownAssert) {
+T_strCut strCut(Z3_theory t, Z3_ast s, Z3_ast offset, std::vector<Z3_ast> & asserts) {
   Z3_context ctx = Z3_theory_get_context(t);
-  Z3_ast ts0 = my_mk_internal_string_var(t);
-  Z3_ast ts1 = my_mk_internal_string_var(t);
-  Z3_ast ts2 = my_mk_internal_string_var(t);
-  Z3_ast and_item[4];
-  and_item[0] = Z3_mk_eq(ctx, args[0], mk_concat(t, ts0, mk_concat(t, ts1, ts2)));
-  and_item[1] = Z3_mk_eq(ctx, args[1], mk_length(t, ts0));
-  and_item[2] = Z3_mk_eq(ctx, args[2], mk_length(t, ts1));
-  breakdownAssert = Z3_mk_and(ctx, 3, and_item);
-  return ts1;
+  bool numOffset = isConstInt(t, offset);
+  int k = numOffset ? getConstIntValue(t, offset) : -1;
+  T_strCut cut;
+  if (numOffset && k == 0) {
+    cut.prefix = my_mk_str_value(t, "");
+    cut.rest = s;
+    return cut;
+  }
+  if (numOffset) {
+    std::map<int, T_strCut> & numCuts = strNumCutMap[s];
+    if (numCuts.find(k) != numCuts.end())
+      return numCuts[k];
+  } else if (strCutMap.find(std::make_pair(s, offset)) != strCutMap.end()) {
+    return strCutMap[std::make_pair(s, offset)];
+  }
+
+  if (numOffset && k > 0 && isConstStr(t, s) && k <= (int) getConstStrValue(t, s).length()) {
+    std::string str = getConstStrValue(t, s);
+    cut.prefix = my_mk_str_value(t, str.substr(0, k).c_str());
+    cut.rest = my_mk_str_value(t, str.substr(k).c_str());
+  } else if (numOffset && k > 0 && strNumCutMap[s].lower_bound(k) != strNumCutMap[s].lower_bound(1)) {
+    std::map<int, T_strCut>::iterator lower = --strNumCutMap[s].lower_bound(k);
+    T_strCut base = lower->second;
+    T_strCut tail = strCut(t, base.rest, mk_int(ctx, k - lower->first), asserts);
+    cut.prefix = mk_concat(t, base.prefix, tail.prefix);
+    cut.rest = tail.rest;
+  } else {
+    cut.prefix = my_mk_internal_string_var(t);
+    cut.rest = my_mk_internal_string_var(t);
+    asserts.push_back(Z3_mk_eq(ctx, s, mk_concat(t, cut.prefix, cut.rest)));
+    asserts.push_back(Z3_mk_eq(ctx, offset, mk_length(t, cut.prefix)));
+  }
+
+  if (numOffset)
+    strNumCutMap[s][k] = cut;
+  else
+    strCutMap[std::make_pair(s, offset)] = cut;
+  return cut;
+}
+
+/*
+ * Substring(s, i, n) is the first n characters of what is left of s after i
+ */
+Z3_ast reduce_subStr(Z3_theory t, Z3_ast const args[], Z3_ast & breakdownAssert) {
+  std::vector<Z3_ast> asserts;
+  T_strCut head = strCut(t, args[0], args[1], asserts);
+  T_strCut piece = strCut(t, head.rest, args[2], asserts);
+  if (!asserts.empty())
+    breakdownAssert = my_mk_and(t, &asserts[0], asserts.size());
+  return piece.prefix;
 }
 
 /*
@@ -6448,11 +7470,15 @@ Z3_ast reduce_indexof(Z3_theory t, Z3_ast const args[], Z3_ast & breakdownAssert
     } else {
       return mk_int(ctx, -1);
     }
+  } else if (indexofViewMap.find(std::make_pair(args[0], args[1])) != indexofViewMap.end()) {
+    // OWN CODE: same string and pattern, the breakdown is already asserted
+    return indexofViewMap[std::make_pair(args[0], args[1])];
   } else {
     Z3_ast x1 = my_mk_internal_string_var(t);
     Z3_ast x2 = my_mk_internal_string_var(t);
     Z3_ast x3 = my_mk_internal_string_var(t);
     Z3_ast indexAst = my_mk_internal_int_var(t);
+    indexofViewMap[std::make_pair(args[0], args[1])] = indexAst;
 
     int pos = 0;
     Z3_ast and_items[7];
@@ -6493,6 +7519,20 @@ Z3_ast reduce_replace(Z3_theory t, Z3_ast const args[], Z3_ast & breakdownAssert
     } else {
       return args[0];
     }
+  } else if (isConstStr(t, args[1]) && getConstStrValue(t, args[1]) == "") {
+    // OWN CODE: the empty pattern occurs first at the very beginning
+    return mk_concat(t, args[2], args[0]);
+  } else if (isConstStr(t, args[0]) && isConstStr(t, args[1])) {
+    // OWN CODE: only the replacement is unknown
+    std::string arg0Str = getConstStrValue(t, args[0]);
+    std::string arg1Str = getConstStrValue(t, args[1]);
+    std::string::size_type index1 = arg0Str.find(arg1Str);
+    if (index1 == std::string::npos) {
+      return args[0];
+    }
+    Z3_ast prefix = my_mk_str_value(t, arg0Str.substr(0, index1).c_str());
+    Z3_ast suffix = my_mk_str_value(t, arg0Str.substr(index1 + arg1Str.length()).c_str());
+    return mk_concat(t, prefix, mk_concat(t, args[2], suffix));
   } else {
     Z3_ast x1 = my_mk_internal_string_var(t);
     Z3_ast x2 = my_mk_internal_string_var(t);
@@ -6500,6 +7540,14 @@ Z3_ast reduce_replace(Z3_theory t, Z3_ast const args[], Z3_ast & breakdownAssert
     Z3_ast indexAst = my_mk_internal_int_var(t);
     Z3_ast result = my_mk_internal_string_var(t);
 
+    // OWN CODE: the first occurrence must not even start inside x1, so a
+    // constant pattern is looked for in x1 followed by all but its last char
+    Z3_ast beforeMatch = x1;
+    if (isConstStr(t, args[1]) && getConstStrValue(t, args[1]).length() > 1) {
+      std::string arg1Str = getConstStrValue(t, args[1]);
+      beforeMatch = mk_concat(t, x1, my_mk_str_value(t, arg1Str.substr(0, arg1Str.length() - 1).c_str()));
+    }
+
     int pos = 0;
     Z3_ast and_items[8];
 
@@ -6513,7 +7561,7 @@ Z3_ast reduce_replace(Z3_theory t, Z3_ast const args[], Z3_ast & breakdownAssert
     //-------------------------------------------
     and_items[pos++] = Z3_mk_iff(ctx, i_ge_zero, Z3_mk_eq(ctx, indexAst, mk_length(t, x1)));
     and_items[pos++] = Z3_mk_iff(ctx, i_ge_zero, Z3_mk_eq(ctx, x2, args[1]));
-    and_items[pos++] = Z3_mk_iff(ctx, i_ge_zero, Z3_mk_not(ctx, mk_contains(t, x1, args[1])));
+    and_items[pos++] = Z3_mk_iff(ctx, i_ge_zero, Z3_mk_not(ctx, mk_contains(t, beforeMatch, args[1])));
     and_items[pos++] = Z3_mk_eq(ctx, result, mk_concat(t, x1, mk_concat(t, args[2], x3)));
     //-------------------------------------------
     breakdownAssert = Z3_mk_and(ctx, pos, and_items);
@@ -6521,17 +7569,447 @@ Z3_ast reduce_replace(Z3_theory t, Z3_ast const args[], Z3_ast & breakdownAssert
   }
 }
 
+/*
+ * OWN CODE
+ */
+std::string replaceAllStr(const std::string & str, const std::string & pattern, const std::string & replacement) {
+  if (pattern == "") {
+    return str;
+  }
+  std::string result;
+  std::string::size_type from = 0;
+  std::string::size_type index = str.find(pattern);
+  while (index != std::string::npos) {
+    result += str.substr(from, index - from) + replacement;
+    from = index + pattern.length();
+    index = str.find(pattern, from);
+  }
+  return result + str.substr(from);
+}
+
+/*
+ * OWN CODE
+ * Strings s with ReplaceAll(s, pattern, replacement) = target, read off the
+ * target left to right: every occurrence of the replacement either came from
+ * the pattern or was there already. False if there are more than maxCount of
+ * them or the search gives up.
+ */
+#define maxReplaceAllSteps 4096
+
+bool replaceAllPreimages(const std::string & target, const std::string & pattern, const std::string & replacement,
+    unsigned int maxCount, std::vector<std::string> & preimages) {
+  if (pattern == "" || replacement == "") {
+    return false;
+  }
+  std::vector<std::pair<unsigned int, std::string> > stack;
+  stack.push_back(std::make_pair(0u, std::string("")));
+  int steps = 0;
+  while (! stack.empty()) {
+    if (++steps > maxReplaceAllSteps) {
+      return false;
+    }
+    unsigned int pos = stack.back().first;
+    std::string prefix = stack.back().second;
+    stack.pop_back();
+    if (pos == target.length()) {
+      if (replaceAllStr(prefix, pattern, replacement) == target) {
+        if (preimages.size() >= maxCount) {
+          return false;
+        }
+        preimages.push_back(prefix);
+      }
+      continue;
+    }
+    stack.push_back(std::make_pair(pos + 1, prefix + target[pos]));
+    if (target.compare(pos, replacement.length(), replacement) == 0) {
+      stack.push_back(std::make_pair(pos + (unsigned int) replacement.length(), prefix + pattern));
+    }
+  }
+  return true;
+}
+
+/*
+ * OWN CODE
+ * ReplaceAll(s, pattern, replacement) is folded on constants. Otherwise the
+ * result is a fresh string tied to s by
+ *   ! Contains(s, pattern) <=> result = s
+ * and, for constant pattern and replacement, by the length change per
+ * occurrence. Its value is settled in cb_final_check by genReplaceAllLemmas().
+ */
+Z3_ast reduce_replaceAll(Z3_theory t, Z3_ast const args[], Z3_ast & breakdownAssert) {
+  Z3_context ctx = Z3_theory_get_context(t);
+  if (isConstStr(t, args[1]) && getConstStrValue(t, args[1]) == "") {
+    return args[0];
+  }
+  if (isConstStr(t, args[0]) && isConstStr(t, args[1]) && isConstStr(t, args[2])) {
+    std::string replaced = replaceAllStr(getConstStrValue(t, args[0]), getConstStrValue(t, args[1]), getConstStrValue(t, args[2]));
+    return my_mk_str_value(t, replaced.c_str());
+  }
+
+  Z3_ast result = my_mk_internal_string_var(t);
+  std::vector<Z3_ast> entry(args, args + 3);
+  replaceAllMap[result] = entry;
+
+  std::vector<Z3_ast> and_items;
+  Z3_ast noMatch = Z3_mk_not(ctx, mk_contains(t, args[0], args[1]));
+  and_items.push_back(Z3_mk_iff(ctx, noMatch, Z3_mk_eq(ctx, result, args[0])));
+  if (isConstStr(t, args[1]) && isConstStr(t, args[2])) {
+    int patternLen = getConstStrValue(t, args[1]).length();
+    int delta = (int) getConstStrValue(t, args[2]).length() - patternLen;
+    if (delta == 0) {
+      and_items.push_back(Z3_mk_eq(ctx, mk_length(t, result), mk_length(t, args[0])));
+    } else {
+      // k occurrences: Length(result) = Length(s) + k * delta, k * |pattern| <= Length(s)
+      Z3_ast k = my_mk_internal_int_var(t);
+      and_items.push_back(Z3_mk_iff(ctx, noMatch, Z3_mk_eq(ctx, k, mk_int(ctx, 0))));
+      and_items.push_back(Z3_mk_ge(ctx, k, mk_int(ctx, 0)));
+      and_items.push_back(Z3_mk_le(ctx, mk_2_mul(t, mk_int(ctx, patternLen), k), mk_length(t, args[0])));
+      and_items.push_back(Z3_mk_eq(ctx, mk_length(t, result), mk_2_add(t, mk_length(t, args[0]), mk_2_mul(t, mk_int(ctx, delta), k))));
+    }
+  }
+  breakdownAssert = Z3_mk_and(ctx, and_items.size(), &and_items[0]);
+  return result;
+}
+
+/*
+ * OWN CODE
+ * For every ReplaceAll result whose arguments have values, assert the value
+ * it must take; for a result with a value (and constant pattern and
+ * replacement), assert the strings s it can come from. A lemma stays
+ * asserted until the level it was added at is popped.
+ * Return true if some lemma was added.
+ */
+bool genReplaceAllLemmas(Z3_theory t) {
+  Z3_context ctx = Z3_theory_get_context(t);
+  std::vector<Z3_ast> lemmas;
+  std::map<Z3_ast, std::vector<Z3_ast> >::iterator it = replaceAllMap.begin();
+  for (; it != replaceAllMap.end(); it++) {
+    Z3_ast result = it->first;
+    std::vector<Z3_ast> values(3);
+    std::vector<Z3_ast> premise;
+    bool allConst = true;
+    for (int i = 0; i < 3; i++) {
+      values[i] = get_eqc_value(t, it->second[i]);
+      if (! isConstStr(t, values[i])) {
+        allConst = false;
+      } else if (values[i] != it->second[i]) {
+        premise.push_back(Z3_mk_eq(ctx, it->second[i], values[i]));
+      }
+    }
+    Z3_ast resultValue = get_eqc_value(t, result);
+
+    if (allConst) {
+      std::string expected = replaceAllStr(getConstStrValue(t, values[0]), getConstStrValue(t, values[1]), getConstStrValue(t, values[2]));
+      if (resultValue == result || getConstStrValue(t, resultValue) != expected) {
+        Z3_ast implyR = Z3_mk_eq(ctx, result, my_mk_str_value(t, expected.c_str()));
+        lemmas.push_back(premise.empty() ? implyR : Z3_mk_implies(ctx, my_mk_and(t, &premise[0], premise.size()), implyR));
+      }
+    } else if (resultValue != result && isConstStr(t, values[1]) && isConstStr(t, values[2])
+        && values[1] == it->second[1] && values[2] == it->second[2]) {
+      std::vector<std::string> preimages;
+      if (! replaceAllPreimages(getConstStrValue(t, resultValue), getConstStrValue(t, values[1]), getConstStrValue(t, values[2]), 16, preimages)) {
+        continue;
+      }
+      Z3_ast implyL = Z3_mk_eq(ctx, result, resultValue);
+      if (preimages.empty()) {
+        lemmas.push_back(Z3_mk_not(ctx, implyL));
+      } else {
+        std::vector<Z3_ast> options;
+        for (unsigned int i = 0; i < preimages.size(); i++) {
+          options.push_back(Z3_mk_eq(ctx, it->second[0], my_mk_str_value(t, preimages[i].c_str())));
+        }
+        Z3_ast implyR = (options.size() == 1) ? options[0] : Z3_mk_or(ctx, options.size(), &options[0]);
+        lemmas.push_back(Z3_mk_implies(ctx, implyL, implyR));
+      }
+    }
+  }
+
+  bool added = false;
+  for (unsigned int i = 0; i < lemmas.size(); i++) {
+    if (replaceAllLemmaLevel.find(lemmas[i]) == replaceAllLemmaLevel.end()) {
+      replaceAllLemmaLevel[lemmas[i]] = sLevel;
+      addAxiom(t, lemmas[i], __LINE__);
+      added = true;
+    }
+  }
+  return added;
+}
+
+/*
+ * OWN CODE
+ * Length(n) for n matching regexStr: one option per arithmetic progression
+ * of the regex length set, or only bounds if there are too many.
+ * NULL if nothing is known or every length is possible.
+ */
+#define maxLengthOptions 8
+
+Z3_ast regexLengthConstraint(Z3_theory t, Z3_ast n, const std::string & regexStr) {
+  Z3_context ctx = Z3_theory_get_context(t);
+  std::vector<std::pair<int, int> > lengths;
+  if (! getRegexLengthSet(regexStr, lengths)) {
+    return NULL;
+  }
+  if (lengths.size() == 0) {
+    return Z3_mk_false(ctx);
+  }
+  if (lengths.size() == 1 && lengths[0].first == 0 && lengths[0].second == 1) {
+    return NULL;
+  }
+  Z3_ast lenAst = mk_length(t, n);
+
+  if (lengths.size() > maxLengthOptions) {
+    bool bounded = true;
+    int maxLen = 0;
+    for (unsigned int i = 0; i < lengths.size(); i++) {
+      bounded = bounded && (lengths[i].second == 0);
+      maxLen = std::max(maxLen, lengths[i].first);
+    }
+    Z3_ast lower = Z3_mk_ge(ctx, lenAst, mk_int(ctx, lengths[0].first));
+    return bounded ? mk_2_and(t, lower, Z3_mk_le(ctx, lenAst, mk_int(ctx, maxLen))) : lower;
+  }
+
+  std::vector<Z3_ast> options;
+  for (unsigned int i = 0; i < lengths.size(); i++) {
+    int base = lengths[i].first;
+    int period = lengths[i].second;
+    if (period == 0) {
+      options.push_back(Z3_mk_eq(ctx, lenAst, mk_int(ctx, base)));
+    } else if (period == 1) {
+      options.push_back(Z3_mk_ge(ctx, lenAst, mk_int(ctx, base)));
+    } else {
+      // Length = base + period * k, k >= 0
+      Z3_ast k = my_mk_internal_int_var(t);
+      Z3_ast step = mk_2_add(t, mk_int(ctx, base), mk_2_mul(t, mk_int(ctx, period), k));
+      options.push_back(mk_2_and(t, Z3_mk_ge(ctx, k, mk_int(ctx, 0)), Z3_mk_eq(ctx, lenAst, step)));
+    }
+  }
+  return (options.size() == 1) ? options[0] : Z3_mk_or(ctx, options.size(), &options[0]);
+}
+
+/*
+ * OWN CODE
+ * Matches atoms on the strings in the eqcs of n1 and n2 (about to be
+ * merged, n2 may be NULL). If the regexes have no common word, the atoms
+ * (with the equalities between their strings) cannot all hold. Otherwise
+ * the shortest common word bounds the length.
+ */
+void matchesEqcCheck(Z3_theory t, Z3_ast n1, Z3_ast n2) {
+  Z3_context ctx = Z3_theory_get_context(t);
+  std::vector<Z3_ast> terms;
+  std::vector<std::string> regexes;
+  std::vector<Z3_ast> atoms;
+  std::map<Z3_ast, int> visited;
+  Z3_ast roots[2] = { n1, n2 };
+  for (int r = 0; r < 2; r++) {
+    Z3_ast curr = roots[r];
+    while (curr != NULL && visited.find(curr) == visited.end()) {
+      visited[curr] = 1;
+      std::map<Z3_ast, std::vector<std::pair<std::string, Z3_ast> > >::iterator it = matchesAtomMap.find(curr);
+      if (it != matchesAtomMap.end()) {
+        for (unsigned int i = 0; i < it->second.size(); i++) {
+          terms.push_back(curr);
+          regexes.push_back(it->second[i].first);
+          atoms.push_back(it->second[i].second);
+        }
+      }
+      curr = (searchStart == 1) ? Z3_theory_get_eqc_next(t, curr) : NULL;
+    }
+  }
+  Z3_ast n = n1;
+
+  if (atoms.size() < 2) {
+    return;
+  }
+
+  // a conflicting pair gives a shorter lemma than the whole group
+  std::vector<std::vector<unsigned int> > groups;
+  for (unsigned int i = 0; i < atoms.size(); i++) {
+    for (unsigned int j = i + 1; j < atoms.size(); j++) {
+      std::vector<unsigned int> pair;
+      pair.push_back(i);
+      pair.push_back(j);
+      groups.push_back(pair);
+    }
+  }
+  std::vector<unsigned int> all;
+  for (unsigned int i = 0; i < atoms.size(); i++) {
+    all.push_back(i);
+  }
+  if (atoms.size() > 2) {
+    groups.push_back(all);
+  }
+
+  for (unsigned int g = 0; g < groups.size(); g++) {
+    std::vector<std::string> groupRegexes;
+    std::vector<Z3_ast> premise;
+    for (unsigned int k = 0; k < groups[g].size(); k++) {
+      unsigned int i = groups[g][k];
+      groupRegexes.push_back(regexes[i]);
+      premise.push_back(atoms[i]);
+      if (terms[i] != n) {
+        premise.push_back(Z3_mk_eq(ctx, terms[i], n));
+      }
+    }
+    std::string witness;
+    int nonEmpty = regexIntersectionWitness(groupRegexes, witness);
+    Z3_ast lemma = NULL;
+    if (nonEmpty == 0) {
+      lemma = Z3_mk_not(ctx, Z3_mk_and(ctx, premise.size(), &premise[0]));
+    } else if (nonEmpty == 1 && g == groups.size() - 1 && witness.length() > 0) {
+      lemma = Z3_mk_implies(ctx, Z3_mk_and(ctx, premise.size(), &premise[0]),
+          Z3_mk_ge(ctx, mk_length(t, n), mk_int(ctx, witness.length())));
+    }
+    if (lemma != NULL && matchesLemmaAdded.find(lemma) == matchesLemmaAdded.end()) {
+      matchesLemmaAdded[lemma] = 1;
+      addAxiom(t, lemma, __LINE__);
+    }
+    if (nonEmpty == 0) {
+      return;
+    }
+  }
+}
+
+/*
+ * OWN CODE
+ * Offer values drawn from the automata to the strings under Matches atoms
+ * that have no value yet, before they are tested as free variables:
+ *   atoms => (tester = "0" /\ x = w0) \/ ... \/ tester = "more"
+ * Return true if some options were added.
+ */
+bool genMatchesWitnessOptions(Z3_theory t) {
+  Z3_context ctx = Z3_theory_get_context(t);
+  bool added = false;
+  std::map<Z3_ast, std::vector<std::pair<std::string, Z3_ast> > >::iterator it = matchesAtomMap.begin();
+  for (; it != matchesAtomMap.end(); it++) {
+    Z3_ast var = it->first;
+    if (getNodeType(t, var) != my_Z3_Str_Var || matchesWitnessLevel.find(var) != matchesWitnessLevel.end()
+        || eqcHasConst(t, var)) {
+      continue;
+    }
+    matchesWitnessLevel[var] = sLevel;
+    std::vector<std::string> regexes;
+    std::vector<Z3_ast> premise;
+    for (unsigned int i = 0; i < it->second.size(); i++) {
+      regexes.push_back(it->second[i].first);
+      premise.push_back(it->second[i].second);
+    }
+    // only steer the choice: words that keep the constant ends of the Concats in the eqc
+    Z3_ast curr = var;
+    do {
+      if (isConcatFunc(t, curr)) {
+        Z3_ast left = getMostLeftNodeInConcat(t, curr);
+        Z3_ast right = getMostRightNodeInConcat(t, curr);
+        if (isConstStr(t, left)) {
+          regexes.push_back(regexLiteralText(getConstStrValue(t, left)) + "[\\s\\S]*");
+        }
+        if (isConstStr(t, right)) {
+          regexes.push_back("[\\s\\S]*" + regexLiteralText(getConstStrValue(t, right)));
+        }
+      }
+      curr = Z3_theory_get_eqc_next(t, curr);
+    } while (curr != var);
+    std::vector<std::string> words;
+    if (! regexWitnessCandidates(regexes, 3, words) || words.size() == 0) {
+      continue;
+    }
+    // offered again after a pop: same tester, the options went with the scope
+    Z3_ast tester = matchesWitnessTester[var];
+    if (tester == NULL) {
+      std::stringstream ss;
+      ss << "_t_mw_" << Z3_ast_to_string(ctx, var);
+      tester = my_mk_str_var(t, ss.str().c_str());
+      matchesWitnessTester[var] = tester;
+    }
+    std::vector<Z3_ast> options;
+    for (unsigned int i = 0; i < words.size(); i++) {
+      Z3_ast choice = Z3_mk_eq(ctx, tester, my_mk_str_value(t, intToString(i).c_str()));
+      options.push_back(mk_2_and(t, choice, Z3_mk_eq(ctx, var, my_mk_str_value(t, words[i].c_str()))));
+    }
+    options.push_back(Z3_mk_eq(ctx, tester, my_mk_str_value(t, "more")));
+    Z3_ast premiseAst = premise.size() == 1 ? premise[0] : Z3_mk_and(ctx, premise.size(), &premise[0]);
+    addAxiom(t, Z3_mk_implies(ctx, premiseAst, Z3_mk_or(ctx, options.size(), &options[0])), __LINE__);
+    added = true;
+  }
+  return added;
+}
+
+/*
+ * OWN CODE
+ * A fresh string under one Matches atom that is not reduced: the automaton
+ * decides it once the string has a value (regexAtomCheck), the length set
+ * bounds it before that. Used for the parts of a regex that would otherwise
+ * need a term per character or per repetition.
+ */
+Z3_ast mkRegexAtomVar(Z3_theory t, const std::string & regexStr, std::vector<Z3_ast> & asserts) {
+  Z3_context ctx = Z3_theory_get_context(t);
+  PATheoryData * td = (PATheoryData *) Z3_theory_get_ext_data(t);
+  Z3_ast var = my_mk_internal_string_var(t);
+  // registered first: reduce_matches leaves the atom below alone
+  regexAtomVarMap[var] = std::make_pair(regexStr, (Z3_ast) NULL);
+  Z3_ast atom = mk_2_arg_app(ctx, td->Matches, var, my_mk_regex_value(t, regexStr.c_str()));
+  regexAtomVarMap[var].second = atom;
+  matchesAtomMap[var].push_back(std::make_pair(regexStr, atom));
+  asserts.push_back(atom);
+  Z3_ast lengthAst = regexLengthConstraint(t, var, regexStr);
+  if (lengthAst != NULL) {
+    asserts.push_back(lengthAst);
+  }
+  return var;
+}
+
+/*
+ * OWN CODE
+ * The eqcs of n1 and n2 are about to be merged and one of them has a
+ * constant: decide the Matches atoms of the regex atom vars in both.
+ */
+void regexAtomCheck(Z3_theory t, Z3_ast n1, Z3_ast n2) {
+  Z3_context ctx = Z3_theory_get_context(t);
+  Z3_ast value = get_eqc_value(t, n1);
+  if (! isConstStr(t, value)) {
+    value = get_eqc_value(t, n2);
+    if (! isConstStr(t, value)) {
+      return;
+    }
+  }
+  std::string str = getConstStrValue(t, value);
+  Z3_ast roots[2] = { n1, n2 };
+  for (int r = 0; r < 2; r++) {
+    Z3_ast curr = roots[r];
+    do {
+      std::map<Z3_ast, std::pair<std::string, Z3_ast> >::iterator it = regexAtomVarMap.find(curr);
+      if (it != regexAtomVarMap.end()) {
+        const std::string & regexStr = it->second.first;
+        int isMatch = regexBatchMatch(regexStr, str);
+        if (isMatch == -1) {
+          isMatch = boost::regex_match(str, boost::regex(regexStr, boostRegexFlags)) ? 1 : 0;
+        }
+        Z3_ast atom = it->second.second;
+        addAxiom(t, Z3_mk_implies(ctx, Z3_mk_eq(ctx, curr, value), isMatch == 1 ? atom : Z3_mk_not(ctx, atom)), __LINE__);
+      }
+      curr = Z3_theory_get_eqc_next(t, curr);
+    } while (curr != roots[r]);
+  }
+}
+
 /*
  * OWN CODE
  */
 Z3_ast reduce_matches(Z3_theory t, Z3_ast const args[], Z3_ast & breakDownAssert) {
   Z3_context ctx = Z3_theory_get_context(t);
   Z3_ast reduceAst = NULL;
+  std::map<Z3_ast, std::pair<std::string, Z3_ast> >::iterator atomVar = regexAtomVarMap.find(args[0]);
+  if (atomVar != regexAtomVarMap.end() && atomVar->second.first == getRegexString(t, args[1])) {
+    // decided by regexAtomCheck
+    return NULL;
+  }
   if (isValidRegex(t, args[1])){
-    boost::regex arg1Regex = getRegexValue(t, args[1]);
     if ( isConstStr(t, args[0])) {
       std::string arg0Str = getConstStrValue(t, args[0]);
-      if (! boost::regex_match(arg0Str, arg1Regex)) {
+      int isMatch = regexBatchMatch(getRegexString(t, args[1]), arg0Str);
+      if (isMatch == -1) {
+        isMatch = boost::regex_match(arg0Str, getRegexValue(t, args[1])) ? 1 : 0;
+      }
+      if (isMatch == 0) {
         reduceAst = Z3_mk_false(ctx);
         breakDownAssert = NULL;
       } else {
@@ -6540,7 +8018,29 @@ Z3_ast reduce_matches(Z3_theory t, Z3_ast const args[], Z3_ast & breakDownAssert
       }
     } else {
       std::string regexStr = getRegexString(t, args[1]);
-      reduceAst = Z3_mk_eq(ctx, args[0], regex_parse(t, regexStr, breakDownAssert));
+      Z3_ast regexAst = regex_parse(t, regexStr, breakDownAssert);
+      if (regexAst == NULL) {
+        // the parser rejects the pattern: leave Matches uninterpreted
+        return NULL;
+      }
+      reduceAst = Z3_mk_eq(ctx, args[0], regexAst);
+      Z3_ast lengthAst = regexLengthConstraint(t, args[0], regexStr);
+      if (lengthAst != NULL) {
+        breakDownAssert = mk_2_and(t, breakDownAssert, Z3_mk_implies(ctx, reduceAst, lengthAst));
+      }
+      if (reduceAst != NULL && args[0] != NULL) {
+        std::vector<std::pair<std::string, Z3_ast> > & known = matchesAtomMap[args[0]];
+        bool isNew = true;
+        for (unsigned int i = 0; i < known.size(); i++) {
+          isNew = isNew && (known[i].first != regexStr);
+        }
+        if (isNew) {
+          known.push_back(std::make_pair(regexStr, reduceAst));
+          if (known.size() >= 2) {
+            matchesEqcCheck(t, args[0], NULL);
+          }
+        }
+      }
     }
   } else { //TODO what if not validRegex??
     //TODO
@@ -6661,11 +8161,15 @@ Z3_bool cb_reduce_app(Z3_theory t, Z3_func_decl d, unsigned n, Z3_ast const * ar
     printZ3Node(t, convertedArgs[2]);
     __debugPrint(logFile, ")  =>  ");
     printZ3Node(t, *result);
-    __debugPrint(logFile, "\n-- ADD(@%d, Level %d):\n", __LINE__, sLevel);
-    printZ3Node(t, breakDownAst);
+    if (breakDownAst != NULL) {
+      __debugPrint(logFile, "\n-- ADD(@%d, Level %d):\n", __LINE__, sLevel);
+      printZ3Node(t, breakDownAst);
+    }
     __debugPrint(logFile, "\n===================\n");
 #endif
-    Z3_assert_cnstr(ctx, breakDownAst);
+    // cuts already made (or folded on a constant) add nothing
+    if (breakDownAst != NULL)
+      Z3_assert_cnstr(ctx, breakDownAst);
     delete[] convertedArgs;
     return Z3_TRUE;
   }
@@ -6789,6 +8293,39 @@ Z3_bool cb_reduce_app(Z3_theory t, Z3_func_decl d, unsigned n, Z3_ast const * ar
     return Z3_TRUE;
   }
 
+  /*
+   * OWN CODE
+   */
+  //------------------------------------------
+  // Reduce app: ReplaceAll
+  //------------------------------------------
+  if (d == td->ReplaceAll) {
+    Z3_ast breakDownAst = NULL;
+    *result = reduce_replaceAll(t, convertedArgs, breakDownAst);
+#ifdef DEBUGLOG
+    __debugPrint(logFile, "\n===================\n");
+    __debugPrint(logFile, "** cb_reduce_app(): ReplaceAll(");
+    printZ3Node(t, convertedArgs[0]);
+    __debugPrint(logFile, ", ");
+    printZ3Node(t, convertedArgs[1]);
+    __debugPrint(logFile, ", ");
+    printZ3Node(t, convertedArgs[2]);
+    __debugPrint(logFile, ")");
+    __debugPrint(logFile, "  =>  ");
+    printZ3Node(t, *result);
+    if( breakDownAst != NULL )
+    {
+      __debugPrint(logFile, "\n-- ADD(@%d): \n", __LINE__);
+      printZ3Node(t, breakDownAst);
+    }
+    __debugPrint(logFile, "\n===================\n");
+#endif
+    if (breakDownAst != NULL)
+      Z3_assert_cnstr(ctx, breakDownAst);
+    delete[] convertedArgs;
+    return Z3_TRUE;
+  }
+
   /*
    * OWN CODE
    */
@@ -6911,6 +8448,66 @@ void cb_pop(Z3_theory t) {
       varItor++;
   }
 
+  // split windows asserted above this level are gone with their axioms
+  std::map<std::pair<Z3_ast, Z3_ast>, T_concatSplit>::iterator splitItor = pendingConcatSplit.begin();
+  for (; splitItor != pendingConcatSplit.end(); splitItor++) {
+    std::vector<std::pair<int, int> > & windows = splitItor->second.windows;
+    while (! windows.empty() && windows.back().first > sLevel)
+      windows.pop_back();
+  }
+
+  std::map<std::pair<Z3_ast, Z3_ast>, int>::iterator arrItor = arrangementLevel.begin();
+  while (arrItor != arrangementLevel.end()) {
+    if (arrItor->second > sLevel) {
+      if (isConcatFunc(t, arrItor->first.first) && isConcatFunc(t, arrItor->first.second))
+        arrangementPending.insert(arrItor->first);
+      arrangementLevel.erase(arrItor++);
+    } else {
+      arrItor++;
+    }
+  }
+
+  std::map<Z3_ast, int>::iterator seqRepItor = concatSeqRepLevel.begin();
+  while (seqRepItor != concatSeqRepLevel.end()) {
+    if (seqRepItor->second > sLevel)
+      concatSeqRepLevel.erase(seqRepItor++);
+    else
+      seqRepItor++;
+  }
+
+  std::map<std::pair<Z3_ast, Z3_ast>, int>::iterator eqPairItor = concatEqPairLevel.begin();
+  while (eqPairItor != concatEqPairLevel.end()) {
+    if (eqPairItor->second > sLevel)
+      concatEqPairLevel.erase(eqPairItor++);
+    else
+      eqPairItor++;
+  }
+
+  // eqc status cached or merged above this level
+  while (! eqcInfoTrail.empty() && eqcInfoTrail.back().level > sLevel) {
+    T_eqcInfoUndo & undo = eqcInfoTrail.back();
+    if (undo.hadInfo)
+      eqcInfoMap[undo.root] = undo.info;
+    else
+      eqcInfoMap.erase(undo.root);
+    eqcInfoTrail.pop_back();
+  }
+
+  std::map<Z3_ast, int>::iterator lemmaItor = replaceAllLemmaLevel.begin();
+  while (lemmaItor != replaceAllLemmaLevel.end()) {
+    if (lemmaItor->second > sLevel)
+      replaceAllLemmaLevel.erase(lemmaItor++);
+    else
+      lemmaItor++;
+  }
+
+  std::map<Z3_ast, int>::iterator witnessItor = matchesWitnessLevel.begin();
+  while (witnessItor != matchesWitnessLevel.end()) {
+    if (witnessItor->second > sLevel)
+      matchesWitnessLevel.erase(witnessItor++);
+    else
+      witnessItor++;
+  }
 }
 
 /*
@@ -7090,11 +8687,19 @@ void display_model(Z3_theory t, FILE * out, Z3_model m) {
 /*
  *
  */
-int check(Z3_theory t) {
+int check(Z3_theory t, unsigned numAssumptions, Z3_ast * assumptions) {
   int isSAT = -1;
   Z3_model m = 0;
   Z3_context ctx = Z3_theory_get_context(t);
-  Z3_lbool result = Z3_check_and_get_model(ctx, &m);
+  Z3_lbool result = Z3_L_UNDEF;
+  std::vector<Z3_ast> core(numAssumptions);
+  unsigned coreSize = 0;
+  if (numAssumptions == 0) {
+    result = Z3_check_and_get_model(ctx, &m);
+  } else {
+    Z3_ast proof = NULL;
+    result = Z3_check_assumptions(ctx, numAssumptions, assumptions, &m, &proof, &coreSize, &core[0]);
+  }
   __debugPrint(logFile, "\n*****************************\n");
   printf("************************\n>> ");
 
@@ -7107,6 +8712,19 @@ int check(Z3_theory t) {
       } else {
         printf("UNSAT\n");
         __debugPrint(logFile, "UNSAT\n");
+        if (numAssumptions > 0) {
+          // core as indices of the top-level assertions, in input order
+          printf(">> UNSAT CORE (%u):", numAssumptions);
+          for (unsigned i = 0; i < numAssumptions; i++) {
+            for (unsigned j = 0; j < coreSize; j++) {
+              if (core[j] == assumptions[i]) {
+                printf(" %u", i);
+                break;
+              }
+            }
+          }
+          printf("\n");
+        }
       }
       break;
     }
@@ -7205,6 +8823,13 @@ Z3_theory mk_pa_theory(Z3_context ctx) {
   replace_domain[2] = td->String;
   td->Replace = Z3_theory_mk_func_decl(ctx, Th, replace_name, 3, replace_domain, td->String);
   //---------------------------
+  Z3_symbol replaceAll_name = Z3_mk_string_symbol(ctx, "ReplaceAll");
+  Z3_sort replaceAll_domain[3];
+  replaceAll_domain[0] = td->String;
+  replaceAll_domain[1] = td->String;
+  replaceAll_domain[2] = td->String;
+  td->ReplaceAll = Z3_theory_mk_func_decl(ctx, Th, replaceAll_name, 3, replaceAll_domain, td->String);
+  //---------------------------
   Z3_symbol matches_name = Z3_mk_string_symbol(ctx, "Matches");
   Z3_sort matches_domain[2];
   matches_domain[0] = td->String;
@@ -7283,8 +8908,29 @@ void pa_theory_example() {
   __debugPrint(logFile, "\n-----------------------------------------------\n\n");
 #endif
 
-  Z3_assert_cnstr(ctx, fs);
-  check(Th);
+  if (!extractUnsatCore) {
+    Z3_assert_cnstr(ctx, fs);
+    check(Th);
+  } else {
+    // guard every top-level assertion with an assumption literal
+    std::vector<Z3_ast> items;
+    if (Z3_get_ast_kind(ctx, fs) == Z3_APP_AST && Z3_get_decl_kind(ctx, Z3_get_app_decl(ctx, Z3_to_app(ctx, fs))) == Z3_OP_AND) {
+      int argCount = Z3_get_app_num_args(ctx, Z3_to_app(ctx, fs));
+      for (int i = 0; i < argCount; i++)
+        items.push_back(Z3_get_app_arg(ctx, Z3_to_app(ctx, fs), i));
+    } else {
+      items.push_back(fs);
+    }
+    std::vector<Z3_ast> assumptions;
+    for (unsigned int i = 0; i < items.size(); i++) {
+      std::stringstream ss;
+      ss << "_t_core_" << i;
+      Z3_ast guard = mk_bool_var(ctx, ss.str().c_str());
+      Z3_assert_cnstr(ctx, Z3_mk_implies(ctx, guard, items[i]));
+      assumptions.push_back(guard);
+    }
+    check(Th, assumptions.size(), &assumptions[0]);
+  }
 
   // clean up
   Z3_del_context(ctx);
@@ -49,6 +49,8 @@ extern int charSetSize;
 extern const std::string escapeDict[];
 
 extern bool avoidLoopCut;
+extern bool extractUnsatCore;
+extern bool useNielsen;
 extern FILE * logFile;
 extern std::string inputFile;
 //--------------------------------------------------
@@ -69,6 +71,7 @@ typedef struct _PATheoryData
     Z3_func_decl EndsWith;
     Z3_func_decl Contains;
     Z3_func_decl Replace;
+    Z3_func_decl ReplaceAll;
     Z3_func_decl Matches;
     Z3_func_decl Star;
 
@@ -99,6 +102,8 @@ typedef enum
 //--------------------------------------------------
 void setAlphabet();
 
+void resetStrTheoryState();
+
 Z3_ast mk_var(Z3_context ctx, const char * name, Z3_sort ty);
 
 Z3_ast mk_bool_var(Z3_context ctx, const char * name);
@@ -131,9 +136,9 @@ inline bool isValidRegex(Z3_theory t, Z3_ast n);
 
 inline bool isSimpleRegex(Z3_theory t, Z3_ast n);
 
-void getStarableFromStart(int * * dp, const boost::regex & regexTemp, const std::string & const_str);
+void getStarableFromStart(int * * dp, const std::string & regexStr, const std::string & const_str);
 
-void getStarableFromEnd(int * * dp, const boost::regex & regexTemp, const std::string & const_str);
+void getStarableFromEnd(int * * dp, const std::string & regexStr, const std::string & const_str);
 
 Z3_ast mk_1_arg_app(Z3_context ctx, Z3_func_decl f, Z3_ast x);
 
@@ -153,7 +158,11 @@ Z3_ast mk_2_mul(Z3_theory t, Z3_ast mul1, Z3_ast mul2);
 
 Z3_ast mk_concat(Z3_theory t, Z3_ast n1, Z3_ast n2);
 
-Z3_ast mk_star(Z3_theory t, Z3_ast n1, Z3_ast n2, Z3_ast & assert);
+Z3_ast unrollStar(Z3_theory t, Z3_ast owner, Z3_ast n1, int count, Z3_ast & assert);
+
+Z3_ast mk_star(Z3_theory t, Z3_ast n1, Z3_ast n2, Z3_ast & assert, Z3_ast owner = NULL);
+
+bool inStarMap(Z3_theory t, Z3_ast n1, Z3_ast n2);
 
 //Z3_ast normalize(Z3_theory t, Z3_ast unnomarlizedAst, Z3_ast & assert);
 
@@ -163,6 +172,27 @@ void print_eq_class(Z3_theory t, Z3_ast n);
 
 void __printZ3Node(Z3_theory t, Z3_ast node);
 
+/*
+ * What is known about an eqc: its constant (NULL if none), whether that
+ * constant is "" and its length (-1 without a constant)
+ */
+typedef struct _T_eqcInfo
+{
+    Z3_ast value;
+    bool empty;
+    int length;
+} T_eqcInfo;
+
+T_eqcInfo getEqcInfo(Z3_theory t, Z3_ast n);
+
+bool eqcHasConst(Z3_theory t, Z3_ast n);
+
+bool eqcIsEmptyStr(Z3_theory t, Z3_ast n);
+
+int eqcConstLength(Z3_theory t, Z3_ast n);
+
+void mergeEqcInfo(Z3_theory t, Z3_ast nn1, Z3_ast nn2);
+
 Z3_ast get_eqc_value(Z3_theory t, Z3_ast n);
 
 inline bool isStarFunc(Z3_theory t, Z3_ast n);
@@ -203,6 +233,8 @@ void simplifyStarEqConcat(Z3_theory t, Z3_ast nn1, Z3_ast nn2, int duplicateChec
 
 int newEqCheck(Z3_theory t, Z3_ast nn1, Z3_ast nn2);
 
+void strNewEq(Z3_theory t, Z3_ast nn1, Z3_ast nn2);
+
 void cb_new_eq(Z3_theory t, Z3_ast n1, Z3_ast n2);
 
 Z3_ast genFreeVarOptions(Z3_theory t, Z3_ast freeVar, Z3_ast len_indicator, std::string indicatorStr,
@@ -242,7 +274,7 @@ void cb_new_relevant(Z3_theory t, Z3_ast n);
 
 void cb_delete(Z3_theory t);
 
-int check(Z3_theory t);
+int check(Z3_theory t, unsigned numAssumptions = 0, Z3_ast * assumptions = NULL);
 
 Z3_theory mk_pa_theory(Z3_context ctx);
 
@@ -256,8 +288,46 @@ void classifyAstByType(Z3_theory t, Z3_ast node, std::map<Z3_ast, int> & varMap,
 
 void basicConcatAxiom(Z3_theory t, Z3_ast vNode, int line);
 
+/*
+ * Interned string constant with its KMP failure table, for substring search
+ */
+typedef struct _T_constIndex
+{
+    std::string value;
+    std::vector<int> fail;
+} T_constIndex;
+
+const T_constIndex * getConstIndex(Z3_theory t, Z3_ast constAst);
+
+int constIndexFind(const T_constIndex * pattern, const std::string & text, int from, int to);
+
+/*
+ * Flattened view of a Concat tree, built once per Concat node.
+ * seqId is shared by every Concat spelling the same sequence of leaves
+ * (adjacent constants merged, empty constants dropped), stored once per
+ * seqId (getConcatSeqLeaves).
+ * constPieces are those merged constants in order; constFirst / constLast
+ * tell whether the sequence starts / ends with one of them.
+ */
+typedef struct _T_concatView
+{
+    Z3_ast mostLeft;
+    Z3_ast mostRight;
+    int constLength;
+    int seqId;
+    std::vector<const T_constIndex *> constPieces;
+    bool constFirst;
+    bool constLast;
+} T_concatView;
+
+const T_concatView * getConcatView(Z3_theory t, Z3_ast node);
+
+bool sameConcatSeq(Z3_theory t, Z3_ast n1, Z3_ast n2);
+
 void getNodesInConcat(Z3_theory t, Z3_ast node, std::vector<Z3_ast> & nodeList);
 
+const std::vector<Z3_ast> & getConcatSeqLeaves(Z3_theory t, Z3_ast node);
+
 Z3_ast getMostLeftNodeInConcat(Z3_theory t, Z3_ast node);
 
 Z3_ast getMostRightNodeInConcat(Z3_theory t, Z3_ast node);
@@ -292,24 +362,199 @@ void strEqLengthAxiom(Z3_theory t, Z3_ast varAst, Z3_ast strAst, int line);
 
 void addAxiom(Z3_theory t, Z3_ast toAssert, int line, bool display = true);
 
+bool arrangementLive(Z3_ast n1, Z3_ast n2);
+
+void addArrangementAxiom(Z3_theory t, Z3_ast n1, Z3_ast n2, Z3_ast toAssert, int line);
+
+void splitPendingArrangements(Z3_theory t);
+
 void basicStrVarAxiom(Z3_theory t, Z3_ast vNode, int line);
 
+bool concatEqAnalysed(Z3_theory t, Z3_ast v1, Z3_ast v2);
+
 void handleNodesEqual(Z3_theory t, Z3_ast v1, Z3_ast v2);
 
-int canConcatEqStr(Z3_theory t, Z3_ast concat, std::string str);
+int canConcatEqStr(Z3_theory t, Z3_ast concat, const std::string & str);
+
+int canConcatEqStr(Z3_theory t, Z3_ast concat, const std::string & str, int begin, int strLen);
 
 int canConcatEqConcat(Z3_theory t, Z3_ast concat1, Z3_ast concat2);
 
 void doubleCheckForNotContain(Z3_theory t);
 
+void matchesEqcCheck(Z3_theory t, Z3_ast n1, Z3_ast n2);
+
+Z3_ast mkRegexAtomVar(Z3_theory t, const std::string & regexStr, std::vector<Z3_ast> & asserts);
+
+void regexAtomCheck(Z3_theory t, Z3_ast n1, Z3_ast n2);
+
+bool genMatchesWitnessOptions(Z3_theory t);
+
+void genConcatSplitWindow(Z3_theory t, Z3_ast concatAst, Z3_ast constStr, Z3_ast arg1, Z3_ast arg2, int from, int to);
+
+void genConcatSplitPoints(Z3_theory t, Z3_ast concatAst, Z3_ast constStr, Z3_ast arg1, Z3_ast arg2, const std::vector<int> & points);
+
+void addRegexSplitAxiom(Z3_theory t, Z3_ast concatAst, Z3_ast constStr, Z3_ast arg1, Z3_ast arg2);
+
+bool genPendingConcatSplits(Z3_theory t);
+
 void pa_theory_example();
+
+int smtStreamMain(std::string fileName);
+
 Z3_ast reduce_star(Z3_theory t, Z3_ast const args[], Z3_ast & breakDownAssert);
 
+std::string replaceAllStr(const std::string & str, const std::string & pattern, const std::string & replacement);
+
+bool replaceAllPreimages(const std::string & target, const std::string & pattern, const std::string & replacement,
+    unsigned int maxCount, std::vector<std::string> & preimages);
+
+Z3_ast reduce_replaceAll(Z3_theory t, Z3_ast const args[], Z3_ast & breakdownAssert);
+
+bool genReplaceAllLemmas(Z3_theory t);
+
+/*
+ * A position in a string: s = prefix . rest, Length(prefix) = the offset
+ */
+typedef struct _T_strCut
+{
+    Z3_ast prefix;
+    Z3_ast rest;
+} T_strCut;
+
+T_strCut strCut(Z3_theory t, Z3_ast s, Z3_ast offset, std::vector<Z3_ast> & asserts);
+
 //Parser functions
 
+/*
+ * Set of characters as sorted, disjoint, non-adjacent ranges [first, second]
+ */
+typedef std::vector<std::pair<int, int> > T_charClass;
+
+typedef enum
+{
+  regex_Empty,
+  regex_Literal,     // literal
+  regex_Any,         // .
+  regex_Class,       // [...], \d, ...
+  regex_Concat,
+  regex_Union,
+  regex_Star,
+  regex_Plus,
+  regex_Question,
+  regex_Counter,     // {low,high}, high == -1: unbounded
+  regex_Begin,       // ^, only at the start of the pattern
+  regex_End          // $, only at the end of the pattern
+} T_regexKind;
+
+/*
+ * Parsed regex, interned: equal sub-patterns share one node.
+ * text is the source of the sub-pattern, a valid regex on its own.
+ */
+typedef struct _T_regexNode
+{
+    T_regexKind kind;
+    std::string text;
+    std::string literal;
+    T_charClass charClass;
+    int low;
+    int high;
+    std::vector<const struct _T_regexNode *> children;
+} T_regexNode;
+
+const T_regexNode * getRegexAst(const std::string & regexStr);
+
+std::string regexLiteralText(const std::string & literal);
+
+void charClassAddRange(T_charClass & cls, int first, int second);
+
+bool charClassContains(const T_charClass & cls, int c);
+
+int charClassSize(const T_charClass & cls);
+
+T_charClass charClassUnion(const T_charClass & a, const T_charClass & b);
+
+T_charClass charClassIntersect(const T_charClass & a, const T_charClass & b);
+
+T_charClass charClassComplement(const T_charClass & a);
+
+//Automata functions
+
+typedef struct _T_nfaState
+{
+    std::vector<std::pair<T_charClass, int> > trans;
+    std::vector<int> eps;
+} T_nfaState;
+
+typedef struct _T_regexNfa
+{
+    std::vector<T_nfaState> states;
+    int start;
+    int accept;
+} T_regexNfa;
+
+const T_regexNfa * getRegexNfa(const T_regexNode * node);
+
+/*
+ * Match positions of a regex over a string constant: ends[i] lists, sorted,
+ * every j such that constStr[i, j) is accepted. Rows are filled on demand.
+ */
+typedef struct _T_regexMatchIndex
+{
+    const T_regexNfa * nfa;
+    std::string constStr;
+    std::vector<std::vector<int> > ends;
+    std::vector<bool> known;
+} T_regexMatchIndex;
+
+T_regexMatchIndex * getRegexMatchIndex(const std::string & regexStr, const std::string & constStr);
+
+const std::vector<int> & regexMatchEnds(T_regexMatchIndex * index, int begin);
+
+bool regexMatchesSubstr(T_regexMatchIndex * index, int begin, int end);
+
+int regexIntersectionWitness(const std::vector<std::string> & regexes, std::string & witness);
+
+bool getRegexLengthSet(const std::string & regexStr, std::vector<std::pair<int, int> > & lengths);
+
+bool regexWitnessCandidates(const std::vector<std::string> & regexes, int maxCount, std::vector<std::string> & words);
+
+int regexBatchMatch(const std::string & regexStr, const std::string & constStr);
+
+Z3_ast regexLengthConstraint(Z3_theory t, Z3_ast n, const std::string & regexStr);
+
 Z3_ast regex_parse(Z3_theory t, std::string regexStr, Z3_ast & breakDownAssert);
 
 bool isSimpleRegex(std::string regexStr);
 
+//Word equation functions
+
+/*
+ * Side of a word equation: variable ids (>= 0) and characters c as -(c + 1)
+ */
+typedef std::vector<int> T_wordSide;
+
+/*
+ * Nielsen move: var = "" (toEmpty), or var = prefix var' (prefix is a token)
+ */
+typedef struct _T_nielsenMove
+{
+    int var;
+    int prefix;
+    bool toEmpty;
+} T_nielsenMove;
+
+int nielsenSimplify(T_wordSide & lhs, T_wordSide & rhs);
+
+bool nielsenSolvedByEmpty(const T_wordSide & lhs, const T_wordSide & rhs);
+
+void nielsenBranches(const T_wordSide & lhs, const T_wordSide & rhs, std::vector<T_nielsenMove> & moves);
+
+void nielsenApply(const T_wordSide & lhs, const T_wordSide & rhs, const T_nielsenMove & move, T_wordSide & newLhs, T_wordSide & newRhs);
+
+int nielsenSearch(const T_wordSide & lhs, const T_wordSide & rhs);
+
+bool nielsenConcatEq(Z3_theory t, Z3_ast nn1, Z3_ast nn2);
+
 #endif
 
@@ -1,13 +1,12 @@
 #include "strTheory.h"
 
-std::string inputFile;
-
 
 
 int main(int argc, char ** argv)
 {
     logFile = NULL;
     std::string primStr;
+    bool streamMode = false;
     inputFile = std::string("");
     int c;
 
@@ -20,13 +19,16 @@ int main(int argc, char ** argv)
         { "input", required_argument, 0, 'f' },
         { "help", no_argument, 0, 'h' },
         { "allowloopcut", no_argument, 0, 'p' },
+        { "unsatcore", no_argument, 0, 'c' },
+        { "stream", no_argument, 0, 's' },
+        { "nielsen", no_argument, 0, 'n' },
         { 0, 0, 0, 0 }
     };
 
     while (1)
     {
         int option_index = 0;
-        c = getopt_long(argc, argv, "hpf:l:", long_options, &option_index);
+        c = getopt_long(argc, argv, "hpcsnf:l:", long_options, &option_index);
 
         if (c == -1)
             break;
@@ -45,6 +47,25 @@ int main(int argc, char ** argv)
                 avoidLoopCut = false;
                 break;
             }
+            case 'c':
+            {
+                // Report the top-level assertions in the UNSAT core
+                extractUnsatCore = true;
+                break;
+            }
+            case 's':
+            {
+                // Execute SMT-LIB commands one by one from stdin (or -f)
+                streamMode = true;
+                break;
+            }
+            case 'n':
+            {
+                // Solve Concat equalities with Nielsen transformations
+                // before falling back to the arrangement splits
+                useNielsen = true;
+                break;
+            }
             case 'h':
             {
                 break;
@@ -53,6 +74,15 @@ int main(int argc, char ** argv)
                 exit(0);
         }
     }
+
+    if (streamMode) {
+        int ret = smtStreamMain(inputFile);
+#ifdef DEBUGLOG
+        fclose(logFile);
+#endif
+        return ret;
+    }
+
 #ifdef DEBUGLOG
     printf("Input File: %s\n\n", inputFile.c_str());
     __debugPrint(logFile, "Input file: %s\n\n", inputFile.c_str());
@@ -0,0 +1,305 @@
+#include "strTheory.h"
+#include "z3str.h"
+
+/*
+ * Embedding API, see z3str.h
+ */
+
+extern int searchStart;
+extern bool loopDetected;
+
+struct _Z3str_solver
+{
+    Z3_context ctx;
+    Z3_theory th;
+    Z3_model model;
+    std::list<std::string> valueBuf;
+};
+
+bool z3strSolverAlive = false;
+
+/*
+ *
+ */
+Z3str_solver z3str_mk_solver() {
+  if (z3strSolverAlive)
+    return NULL;
+
+  resetStrTheoryState();
+  if (logFile == NULL) {
+    // DEBUGLOG is on by default and every __debugPrint needs a stream
+    logFile = fopen("/dev/null", "w");
+  }
+
+  Z3str_solver s = new _Z3str_solver();
+  s->ctx = mk_my_context();
+  s->th = mk_pa_theory(s->ctx);
+  s->ctx = Z3_theory_get_context(s->th);
+  s->model = 0;
+  setAlphabet();
+
+  z3strSolverAlive = true;
+  return s;
+}
+
+/*
+ *
+ */
+void z3str_del_solver(Z3str_solver s) {
+  if (s == NULL)
+    return;
+  if (s->model)
+    Z3_del_model(s->ctx, s->model);
+  Z3_del_context(s->ctx);
+  delete s;
+  resetStrTheoryState();
+  z3strSolverAlive = false;
+}
+
+/*
+ *
+ */
+Z3_context z3str_get_context(Z3str_solver s) {
+  return s->ctx;
+}
+
+/*
+ *
+ */
+Z3_sort z3str_get_string_sort(Z3str_solver s) {
+  PATheoryData * td = (PATheoryData *) Z3_theory_get_ext_data(s->th);
+  return td->String;
+}
+
+/*
+ *
+ */
+Z3_sort z3str_get_regex_sort(Z3str_solver s) {
+  PATheoryData * td = (PATheoryData *) Z3_theory_get_ext_data(s->th);
+  return td->Regex;
+}
+
+/*
+ *
+ */
+Z3_ast z3str_mk_str_var(Z3str_solver s, const char * name) {
+  PATheoryData * td = (PATheoryData *) Z3_theory_get_ext_data(s->th);
+  return mk_var(s->ctx, name, td->String);
+}
+
+/*
+ *
+ */
+Z3_ast z3str_mk_int_var(Z3str_solver s, const char * name) {
+  return mk_int_var(s->ctx, name);
+}
+
+/*
+ *
+ */
+Z3_ast z3str_mk_bool_var(Z3str_solver s, const char * name) {
+  return mk_bool_var(s->ctx, name);
+}
+
+/*
+ * Constants are interned as theory values named by their content,
+ * so an embedded '\0' cannot be represented.
+ */
+Z3_ast z3str_mk_str_const(Z3str_solver s, const char * bytes, unsigned len) {
+  std::string str(bytes, len);
+  if (str.find('\0') != std::string::npos)
+    return NULL;
+  return my_mk_str_value(s->th, str.c_str());
+}
+
+/*
+ *
+ */
+Z3_ast z3str_mk_regex(Z3str_solver s, const char * bytes, unsigned len) {
+  std::string regex(bytes, len);
+  if (regex.find('\0') != std::string::npos)
+    return NULL;
+  return my_mk_regex_value(s->th, regex.c_str());
+}
+
+/*
+ *
+ */
+Z3_ast z3str_mk_concat(Z3str_solver s, Z3_ast a, Z3_ast b) {
+  PATheoryData * td = (PATheoryData *) Z3_theory_get_ext_data(s->th);
+  return mk_2_arg_app(s->ctx, td->Concat, a, b);
+}
+
+/*
+ *
+ */
+Z3_ast z3str_mk_length(Z3str_solver s, Z3_ast a) {
+  PATheoryData * td = (PATheoryData *) Z3_theory_get_ext_data(s->th);
+  return mk_1_arg_app(s->ctx, td->Length, a);
+}
+
+/*
+ *
+ */
+Z3_ast z3str_mk_substring(Z3str_solver s, Z3_ast a, Z3_ast offset, Z3_ast len) {
+  PATheoryData * td = (PATheoryData *) Z3_theory_get_ext_data(s->th);
+  Z3_ast args[3] = { a, offset, len };
+  return Z3_mk_app(s->ctx, td->SubString, 3, args);
+}
+
+/*
+ *
+ */
+Z3_ast z3str_mk_indexof(Z3str_solver s, Z3_ast a, Z3_ast b) {
+  PATheoryData * td = (PATheoryData *) Z3_theory_get_ext_data(s->th);
+  return mk_2_arg_app(s->ctx, td->Indexof, a, b);
+}
+
+/*
+ *
+ */
+Z3_ast z3str_mk_contains(Z3str_solver s, Z3_ast a, Z3_ast b) {
+  PATheoryData * td = (PATheoryData *) Z3_theory_get_ext_data(s->th);
+  return mk_2_arg_app(s->ctx, td->Contains, a, b);
+}
+
+/*
+ *
+ */
+Z3_ast z3str_mk_startswith(Z3str_solver s, Z3_ast a, Z3_ast b) {
+  PATheoryData * td = (PATheoryData *) Z3_theory_get_ext_data(s->th);
+  return mk_2_arg_app(s->ctx, td->StartsWith, a, b);
+}
+
+/*
+ *
+ */
+Z3_ast z3str_mk_endswith(Z3str_solver s, Z3_ast a, Z3_ast b) {
+  PATheoryData * td = (PATheoryData *) Z3_theory_get_ext_data(s->th);
+  return mk_2_arg_app(s->ctx, td->EndsWith, a, b);
+}
+
+/*
+ *
+ */
+Z3_ast z3str_mk_replace(Z3str_solver s, Z3_ast a, Z3_ast from, Z3_ast to) {
+  PATheoryData * td = (PATheoryData *) Z3_theory_get_ext_data(s->th);
+  Z3_ast args[3] = { a, from, to };
+  return Z3_mk_app(s->ctx, td->Replace, 3, args);
+}
+
+/*
+ *
+ */
+Z3_ast z3str_mk_replaceall(Z3str_solver s, Z3_ast a, Z3_ast from, Z3_ast to) {
+  PATheoryData * td = (PATheoryData *) Z3_theory_get_ext_data(s->th);
+  Z3_ast args[3] = { a, from, to };
+  return Z3_mk_app(s->ctx, td->ReplaceAll, 3, args);
+}
+
+/*
+ *
+ */
+Z3_ast z3str_mk_matches(Z3str_solver s, Z3_ast a, Z3_ast regex) {
+  PATheoryData * td = (PATheoryData *) Z3_theory_get_ext_data(s->th);
+  return mk_2_arg_app(s->ctx, td->Matches, a, regex);
+}
+
+/*
+ *
+ */
+Z3_ast z3str_mk_star(Z3str_solver s, Z3_ast regex, Z3_ast count) {
+  PATheoryData * td = (PATheoryData *) Z3_theory_get_ext_data(s->th);
+  return mk_2_arg_app(s->ctx, td->Star, regex, count);
+}
+
+/*
+ * Same as pa_theory_example(): remember the input variables so that
+ * ctxDepAnalysis can find free ones, then hand the constraint to Z3.
+ */
+void z3str_assert(Z3str_solver s, Z3_ast c) {
+  getVarsInInput(s->th, c);
+#ifdef DEBUGLOG
+  __debugPrint(logFile, "\n>> z3str_assert:\n");
+  printZ3Node(s->th, c);
+  __debugPrint(logFile, "\n");
+#endif
+  Z3_assert_cnstr(s->ctx, c);
+}
+
+/*
+ *
+ */
+Z3str_result z3str_check(Z3str_solver s, unsigned timeout_ms) {
+  if (s->model) {
+    Z3_del_model(s->ctx, s->model);
+    s->model = 0;
+  }
+  s->valueBuf.clear();
+
+  std::stringstream ss;
+  ss << timeout_ms;
+  Z3_update_param_value(s->ctx, "SOFT_TIMEOUT", ss.str().c_str());
+
+  loopDetected = false;
+  Z3_lbool result = Z3_check_and_get_model(s->ctx, &(s->model));
+  // axioms added between two checks go through Z3_assert_cnstr again
+  searchStart = 0;
+
+  switch (result) {
+    case Z3_L_TRUE:
+      return Z3STR_SAT;
+    case Z3_L_FALSE:
+      // a cut loop makes UNSAT unreliable, see check()
+      return loopDetected ? Z3STR_UNKNOWN : Z3STR_UNSAT;
+    default:
+      return Z3STR_UNKNOWN;
+  }
+}
+
+/*
+ *
+ */
+int z3str_get_str_value(Z3str_solver s, Z3_ast a, const char ** bytes, unsigned * len) {
+  if (!s->model)
+    return 0;
+  Z3_ast v = a;
+  if (!Z3_eval(s->ctx, s->model, a, &v))
+    return 0;
+  if (getNodeType(s->th, v) != my_Z3_ConstStr)
+    return 0;
+  s->valueBuf.push_back(getConstStrValue(s->th, v));
+  *bytes = s->valueBuf.back().data();
+  *len = s->valueBuf.back().length();
+  return 1;
+}
+
+/*
+ *
+ */
+int z3str_get_int_value(Z3str_solver s, Z3_ast a, int * value) {
+  if (!s->model)
+    return 0;
+  Z3_ast v = a;
+  if (!Z3_eval(s->ctx, s->model, a, &v))
+    return 0;
+  if (Z3_get_ast_kind(s->ctx, v) != Z3_NUMERAL_AST)
+    return 0;
+  return Z3_get_numeral_int(s->ctx, v, value) ? 1 : 0;
+}
+
+/*
+ *
+ */
+int z3str_get_bool_value(Z3str_solver s, Z3_ast a, int * value) {
+  if (!s->model)
+    return 0;
+  Z3_ast v = a;
+  if (!Z3_eval(s->ctx, s->model, a, &v))
+    return 0;
+  Z3_lbool b = Z3_get_bool_value(s->ctx, v);
+  if (b == Z3_L_UNDEF)
+    return 0;
+  *value = (b == Z3_L_TRUE) ? 1 : 0;
+  return 1;
+}
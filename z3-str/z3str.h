@@ -0,0 +1,114 @@
+#ifndef __z3str_H
+#define __z3str_H 1
+
+#include "z3.h"
+
+/*
+ * Embedding API for the string theory (libz3str.a).
+ *
+ * Terms are built directly in memory: string constants and regexes are
+ * passed as raw bytes, no "__cOnStStR_" / "__regex_" hex encoding is needed.
+ *
+ * The theory keeps its state in globals (see strTheory.cpp), so only one
+ * solver may be alive at a time. Creating a solver resets that state.
+ *
+ * Typical use:
+ *     Z3str_solver s = z3str_mk_solver();
+ *     Z3_ast x = z3str_mk_str_var(s, "x");
+ *     z3str_assert(s, Z3_mk_eq(z3str_get_context(s), x, z3str_mk_str_const(s, "abc", 3)));
+ *     if (z3str_check(s, 1000) == Z3STR_SAT)
+ *         z3str_get_str_value(s, x, &bytes, &len);
+ *     z3str_del_solver(s);
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _Z3str_solver * Z3str_solver;
+
+typedef enum
+{
+  Z3STR_UNSAT   = -1,
+  Z3STR_UNKNOWN =  0,
+  Z3STR_SAT     =  1
+} Z3str_result;
+
+/*
+ * Create / destroy a solver. z3str_mk_solver returns NULL if another
+ * solver is still alive.
+ */
+Z3str_solver z3str_mk_solver();
+
+void z3str_del_solver(Z3str_solver s);
+
+Z3_context z3str_get_context(Z3str_solver s);
+
+Z3_sort z3str_get_string_sort(Z3str_solver s);
+
+Z3_sort z3str_get_regex_sort(Z3str_solver s);
+
+/*
+ * Variables and constants.
+ * Constants may contain any byte except '\0' (returns NULL otherwise).
+ */
+Z3_ast z3str_mk_str_var(Z3str_solver s, const char * name);
+
+Z3_ast z3str_mk_int_var(Z3str_solver s, const char * name);
+
+Z3_ast z3str_mk_bool_var(Z3str_solver s, const char * name);
+
+Z3_ast z3str_mk_str_const(Z3str_solver s, const char * bytes, unsigned len);
+
+Z3_ast z3str_mk_regex(Z3str_solver s, const char * bytes, unsigned len);
+
+/*
+ * String operations, same semantics as the SMT-LIB front end.
+ */
+Z3_ast z3str_mk_concat(Z3str_solver s, Z3_ast a, Z3_ast b);
+
+Z3_ast z3str_mk_length(Z3str_solver s, Z3_ast a);
+
+Z3_ast z3str_mk_substring(Z3str_solver s, Z3_ast a, Z3_ast offset, Z3_ast len);
+
+Z3_ast z3str_mk_indexof(Z3str_solver s, Z3_ast a, Z3_ast b);
+
+Z3_ast z3str_mk_contains(Z3str_solver s, Z3_ast a, Z3_ast b);
+
+Z3_ast z3str_mk_startswith(Z3str_solver s, Z3_ast a, Z3_ast b);
+
+Z3_ast z3str_mk_endswith(Z3str_solver s, Z3_ast a, Z3_ast b);
+
+Z3_ast z3str_mk_replace(Z3str_solver s, Z3_ast a, Z3_ast from, Z3_ast to);
+
+Z3_ast z3str_mk_replaceall(Z3str_solver s, Z3_ast a, Z3_ast from, Z3_ast to);
+
+Z3_ast z3str_mk_matches(Z3str_solver s, Z3_ast a, Z3_ast regex);
+
+Z3_ast z3str_mk_star(Z3str_solver s, Z3_ast regex, Z3_ast count);
+
+/*
+ * Assert a boolean constraint and check satisfiability.
+ * timeout_ms = 0 means no limit; a timeout is reported as Z3STR_UNKNOWN.
+ */
+void z3str_assert(Z3str_solver s, Z3_ast c);
+
+Z3str_result z3str_check(Z3str_solver s, unsigned timeout_ms);
+
+/*
+ * Model access after a Z3STR_SAT answer.
+ * Return 1 on success, 0 if there is no model or no value for the term.
+ * The returned bytes are owned by the solver and stay valid until the
+ * next z3str_check or z3str_del_solver.
+ */
+int z3str_get_str_value(Z3str_solver s, Z3_ast a, const char ** bytes, unsigned * len);
+
+int z3str_get_int_value(Z3str_solver s, Z3_ast a, int * value);
+
+int z3str_get_bool_value(Z3str_solver s, Z3_ast a, int * value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif